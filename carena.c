@@ -0,0 +1,130 @@
+/**
+ *  \file carena.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "carena.h"
+
+/**
+ * \brief Tipo con l'allineamento più restrittivo, come le allocazioni di malloc
+ */
+typedef union {
+  long double align_ld; ///< Allineamento
+  void *align_p; ///< Allineamento
+  long long align_ll; ///< Allineamento
+} align_t;
+
+/// Allineamento dei buffer allocati
+#define ALIGNMENT (sizeof(align_t))
+
+/**
+ * \brief Blocco di memoria da cui vengono presi i buffer
+ */
+typedef union chunk {
+  struct {
+    union chunk *next; ///< Blocco allocato in precedenza
+    size_t size; ///< Dimensione utilizzabile del blocco
+    size_t used; ///< Byte già allocati
+  } h; ///< Intestazione
+  align_t align; ///< Allineamento dei dati che seguono
+} chunk_t;
+
+struct carena {
+  chunk_t *current; ///< Blocco da cui allocare, in testa alla lista dei blocchi
+  chunk_t *first; ///< Primo blocco, conservato ai ripristini
+};
+
+/**
+ * \brief Alloca un nuovo blocco
+ *
+ * \param size Dimensione utilizzabile del blocco
+ * \return chunk_t* Il blocco, NULL e errno impostato in caso di errore
+ */
+static chunk_t *chunk_new(size_t size) {
+  if(size > SIZE_MAX - 2 * sizeof(chunk_t)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  chunk_t *c = malloc(sizeof(chunk_t) + size);
+  if(c == NULL) return NULL;
+  c->h.next = NULL;
+  c->h.size = size;
+  c->h.used = 0;
+  return c;
+}
+
+carena_t *carena_init(size_t chunk_size) {
+  carena_t *arena = malloc(sizeof(carena_t));
+  if(arena == NULL) return NULL;
+
+  arena->first = chunk_new(chunk_size);
+  if(arena->first == NULL) {
+    int err = errno;
+    free(arena);
+    errno = err;
+    return NULL;
+  }
+  arena->current = arena->first;
+  return arena;
+}
+
+void carena_deinit(carena_t *arena) {
+  if(arena == NULL) return;
+
+  carena_reset(arena);
+  free(arena->first);
+  free(arena);
+}
+
+void *carena_alloc(carena_t *arena, size_t size) {
+  if(size > SIZE_MAX - ALIGNMENT) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  /* Ogni buffer occupa un multiplo dell'allineamento, per cui il
+     successivo è già allineato */
+  size_t rounded = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  chunk_t *c = arena->current;
+
+  if(c->h.size - c->h.used < rounded) {
+    /* Il blocco corrente è esaurito: il nuovo è grande almeno quanto il
+       primo, in modo che le richieste piccole successive vi trovino posto */
+    size_t size = rounded > arena->first->h.size ? rounded : arena->first->h.size;
+    c = chunk_new(size);
+    if(c == NULL) return NULL;
+    c->h.next = arena->current;
+    arena->current = c;
+  }
+
+  void *ptr = (char*)(c + 1) + c->h.used;
+  c->h.used += rounded;
+  return ptr;
+}
+
+void *carena_calloc(carena_t *arena, size_t nmemb, size_t size) {
+  if(size != 0 && nmemb > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  void *ptr = carena_alloc(arena, nmemb * size);
+  if(ptr != NULL) memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+void carena_reset(carena_t *arena) {
+  while(arena->current != arena->first) {
+    chunk_t *c = arena->current;
+    arena->current = c->h.next;
+    free(c);
+  }
+  arena->first->h.used = 0;
+}
@@ -0,0 +1,79 @@
+/**
+ *  \file carena.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Arena per allocazioni temporanee
+ * Consente di allocare buffer temporanei semplicemente avanzando un
+ * puntatore all'interno di un blocco di memoria, e di liberarli tutti
+ * insieme con \ref carena_reset.
+ *
+ * L'arena conserva il primo blocco fra un ripristino e l'altro, per cui chi
+ * la usa ripetutamente per operazioni di dimensione simile non passa mai da
+ * malloc. Quando il blocco corrente è esaurito ne viene allocato un altro,
+ * grande almeno quanto la richiesta; i blocchi aggiuntivi vengono
+ * deallocati al ripristino successivo.
+ *
+ * Un'arena non è thread-safe: va usata da un solo thread alla volta.
+ */
+
+#ifndef CARENA_H
+#define CARENA_H
+
+#include <stddef.h>
+
+/// Arena per allocazioni temporanee
+typedef struct carena carena_t;
+
+/**
+ * \brief Inizializza una nuova arena
+ *
+ * \param chunk_size Dimensione del primo blocco, conservato fra un
+ *                   ripristino e l'altro
+ * \return carena_t* NULL e errno impostato in caso di errori
+ */
+carena_t *carena_init(size_t chunk_size);
+
+/**
+ * \brief Distrugge un'arena, deallocando tutta la memoria allocata tramite
+ *        essa
+ *
+ * \param arena L'arena da distruggere, può essere NULL
+ */
+void carena_deinit(carena_t *arena);
+
+/**
+ * \brief Alloca un buffer nell'arena
+ *
+ * Il buffer non va deallocato singolarmente: resta valido fino al
+ * successivo \ref carena_reset o \ref carena_deinit.
+ *
+ * \param arena L'arena in cui allocare
+ * \param size La dimensione del buffer
+ * \return void* Il buffer, non inizializzato. NULL e errno impostato in caso di errore
+ */
+void *carena_alloc(carena_t *arena, size_t size);
+
+/**
+ * \brief Alloca un vettore inizializzato a zero nell'arena
+ *
+ * \param arena L'arena in cui allocare
+ * \param nmemb Il numero di elementi
+ * \param size La dimensione di ogni elemento
+ * \return void* Il vettore, NULL e errno impostato in caso di errore
+ */
+void *carena_calloc(carena_t *arena, size_t nmemb, size_t size);
+
+/**
+ * \brief Libera tutti i buffer allocati nell'arena
+ *
+ * Il primo blocco viene conservato per le allocazioni successive, gli altri
+ * vengono deallocati.
+ *
+ * \param arena L'arena da ripristinare
+ */
+void carena_reset(carena_t *arena);
+
+#endif /* CARENA_H */
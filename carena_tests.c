@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "carena.h"
+
+#define CHUNK 4096
+
+void fill(unsigned char *p, size_t size, unsigned char v) {
+  for(size_t i = 0; i < size; i++) p[i] = v;
+}
+
+void check(const unsigned char *p, size_t size, unsigned char v) {
+  for(size_t i = 0; i < size; i++) assert(p[i] == v);
+}
+
+int main(void) {
+  carena_t *arena = carena_init(CHUNK);
+  assert(arena != NULL);
+
+  /* Buffer allineati e distinti, anche oltre la dimensione del primo
+     blocco e per richieste più grandi di un blocco */
+  unsigned char *bufs[500];
+  size_t sizes[500];
+  for(int i = 0; i < 500; i++) {
+    sizes[i] = i % 50 == 49 ? CHUNK * 3 + i : (size_t)i * 3;
+    bufs[i] = carena_alloc(arena, sizes[i]);
+    assert(bufs[i] != NULL);
+    assert((uintptr_t)bufs[i] % sizeof(void*) == 0);
+    fill(bufs[i], sizes[i], (unsigned char)i);
+  }
+  for(int i = 0; i < 500; i++) {
+    check(bufs[i], sizes[i], (unsigned char)i);
+  }
+
+  /* Dopo il ripristino le allocazioni ripartono dall'inizio del primo
+     blocco */
+  carena_reset(arena);
+  unsigned char *a = carena_alloc(arena, 10);
+  carena_reset(arena);
+  unsigned char *b = carena_alloc(arena, 20);
+  assert(a == b);
+
+  unsigned char *c = carena_calloc(arena, 25, 4);
+  assert(c != NULL && c != b);
+  check(c, 100, 0);
+  assert(carena_calloc(arena, SIZE_MAX / 2, 4) == NULL);
+  assert(carena_alloc(arena, SIZE_MAX) == NULL);
+
+  /* Utilizzo ripetuto, come da parte di un thread che serve richieste */
+  for(int r = 0; r < 1000; r++) {
+    for(int i = 0; i < 20; i++) {
+      size_t size = 1 + (r * 31 + i * 17) % 1000;
+      unsigned char *p = carena_calloc(arena, size, 1);
+      assert(p != NULL);
+      check(p, size, 0);
+      fill(p, size, 0xAB);
+    }
+    carena_reset(arena);
+  }
+
+  carena_deinit(arena);
+  carena_deinit(NULL);
+  return 0;
+}
@@ -66,7 +66,7 @@ int ccircbuf_deinit(ccircbuf_t *buf) {
   return 0;
 }
 
-int ccircbuf_get_elems(ccircbuf_t* buf, void ***dest) {
+int ccircbuf_get_elems(ccircbuf_t* buf, void ***dest, ccircbuf_elem_cb *cb) {
   if(buf == NULL || dest == NULL) {
     errno = EINVAL;
     return -1;
@@ -83,6 +83,7 @@ int ccircbuf_get_elems(ccircbuf_t* buf, void ***dest) {
 
   for(size_t i = 0; i < buf->num; i++) {
     void *elem = buf->elems[(i + buf->ptr) % len];
+    if(cb != NULL) cb(elem);
     (*dest)[i] = elem;
   }
   
@@ -32,14 +32,23 @@ ccircbuf_t *ccircbuf_init(size_t len);
  */
 int ccircbuf_deinit(ccircbuf_t *buf);
 
+/**
+ * \brief Funzione chiamata su ogni elemento estratto dal buffer
+ * 
+ * \param elem L'elemento estratto
+ */
+typedef void(ccircbuf_elem_cb)(void *elem);
+
 /**
  * \brief Estrae tutti gli elementi presenti nel buffer circolare
  * 
  * \param buf Il buffer da cui estrarre gli elementi
  * \param dest Puntatore dove porre gli elementi estratti
+ * \param cb Funzione chiamata su ogni elemento prima che il buffer venga
+ *           sbloccato, ad esempio per acquisirne un riferimento (opzionale)
  * \return int -1 ed errno impostato in caso di errori, il numero di elementi estratti in caso di successo
  */
-int ccircbuf_get_elems(ccircbuf_t* buf, void ***dest);
+int ccircbuf_get_elems(ccircbuf_t* buf, void ***dest, ccircbuf_elem_cb *cb);
 
 /**
  * \brief Inserisce un elemento nel buffer
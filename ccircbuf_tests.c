@@ -16,6 +16,12 @@ void *func(void *ud) {
   return NULL;
 }
 
+int counted = 0;
+
+void count(void *elem) {
+  counted++;
+}
+
 int main(void) {
   ccircbuf_t *buf = ccircbuf_init(16);
   pthread_t threads[8];
@@ -32,8 +38,9 @@ int main(void) {
   }
   
   void **elems;
-  int num = ccircbuf_get_elems(buf, &elems);
+  int num = ccircbuf_get_elems(buf, &elems, count);
   assert(num == 8);
+  assert(counted == 8);
   for(int i = 0; i < 8; i++) {
     assert((int)elems[i] < 8);
   }
@@ -0,0 +1,222 @@
+/**
+ *  \file cebr.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include "cebr.h"
+
+/// Dimensione di una linea di cache
+#define CACHE_LINE 64
+
+/**
+ * \brief Oggetto ritirato in attesa di essere deallocato
+ */
+typedef struct cebr_retired {
+  void *ptr; ///< L'oggetto
+  cebr_free_fn *fn; ///< Funzione che lo dealloca
+  unsigned long epoch; ///< Epoca in cui è stato ritirato
+  struct cebr_retired *next; ///< Oggetto ritirato in precedenza
+} cebr_retired_t;
+
+/**
+ * \brief Stato di un thread che usa le sezioni critiche
+ *
+ * I record non vengono mai deallocati: quando un thread termina il suo
+ * record viene liberato e può essere assegnato ad un nuovo thread, che
+ * eredita anche gli oggetti ritirati ancora in attesa.
+ */
+typedef struct cebr_record {
+  unsigned long state; ///< (epoca << 1) | 1 se il thread è in sezione critica, 0 altrimenti
+  int nesting; ///< Profondità delle sezioni critiche annidate, usata solo dal proprietario
+  int in_use; ///< 1 se il record è assegnato ad un thread
+  cebr_retired_t *limbo; ///< Oggetti ritirati dal thread, dal più recente. Usata solo dal proprietario
+  struct cebr_record *next; ///< Record successivo
+} cebr_record_t;
+
+/// Epoca globale, cresce solamente
+static unsigned long global_epoch = 0;
+
+/// Record di tutti i thread, la lista cresce solamente
+static cebr_record_t *records = NULL;
+
+/// Record del thread corrente
+static __thread cebr_record_t *self = NULL;
+
+/// Chiave usata per liberare il record alla terminazione del thread
+static pthread_key_t record_key;
+
+/// Inizializzazione di \ref record_key
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static void release_record(void *ptr) {
+  cebr_record_t *rec = (cebr_record_t*)ptr;
+  __atomic_store_n(&(rec->state), 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&(rec->in_use), 0, __ATOMIC_RELEASE);
+}
+
+static void make_key(void) {
+  if(pthread_key_create(&record_key, release_record) != 0) abort();
+}
+
+/**
+ * \brief Assegna un record al thread corrente
+ */
+static cebr_record_t *acquire_record(void) {
+  pthread_once(&key_once, make_key);
+
+  /* Riutilizza il record di un thread terminato, se presente */
+  cebr_record_t *rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE);
+  for(; rec != NULL; rec = rec->next) {
+    int expected = 0;
+    if(__atomic_compare_exchange_n(&(rec->in_use), &expected, 1, 0,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+
+  if(rec == NULL) {
+    /* Ogni record occupa una linea di cache, in modo che i thread non
+       scrivano sulla stessa linea entrando nelle sezioni critiche */
+    void *mem;
+    size_t size = sizeof(cebr_record_t) > CACHE_LINE ? sizeof(cebr_record_t) : CACHE_LINE;
+    if(posix_memalign(&mem, CACHE_LINE, size) != 0) abort();
+    rec = (cebr_record_t*)mem;
+    rec->state = 0;
+    rec->in_use = 1;
+    rec->limbo = NULL;
+    rec->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&records, &(rec->next), rec, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+  rec->nesting = 0;
+  pthread_setspecific(record_key, rec);
+  self = rec;
+  return rec;
+}
+
+void cebr_enter(void) {
+  cebr_record_t *rec = self != NULL ? self : acquire_record();
+
+  if(rec->nesting++ == 0) {
+    unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&(rec->state), (epoch << 1) | 1, __ATOMIC_RELAXED);
+    /* L'ingresso deve essere visibile prima di qualsiasi lettura degli
+       oggetti protetti */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+}
+
+void cebr_exit(void) {
+  cebr_record_t *rec = self;
+
+  if(--rec->nesting == 0) {
+    __atomic_store_n(&(rec->state), 0, __ATOMIC_RELEASE);
+  }
+}
+
+/**
+ * \brief Fa avanzare l'epoca globale se tutti i thread in sezione critica
+ *        hanno osservato quella corrente
+ */
+static void try_advance(void) {
+  unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for(cebr_record_t *rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE);
+      rec != NULL; rec = rec->next) {
+    unsigned long state = __atomic_load_n(&(rec->state), __ATOMIC_ACQUIRE);
+    if((state & 1) && (state >> 1) != epoch) return;
+  }
+
+  /* Se un altro thread ha già fatto avanzare l'epoca non ha effetto */
+  __atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, 0,
+                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Stacca dalla lista di un thread gli oggetti ritirati che non
+ *        possono più essere in uso
+ *
+ * \param rec Il record del thread chiamante
+ * \return cebr_retired_t* Gli oggetti da deallocare
+ */
+static cebr_retired_t *detach_expired(cebr_record_t *rec) {
+  unsigned long epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+
+  /* Gli oggetti sono ordinati per epoca decrescente */
+  cebr_retired_t **ptr = &(rec->limbo);
+  while(*ptr != NULL && (*ptr)->epoch + 2 > epoch) {
+    ptr = &((*ptr)->next);
+  }
+
+  cebr_retired_t *expired = *ptr;
+  *ptr = NULL;
+  return expired;
+}
+
+static void free_retired(cebr_retired_t *list) {
+  while(list != NULL) {
+    cebr_retired_t *next = list->next;
+    list->fn(list->ptr);
+    free(list);
+    list = next;
+  }
+}
+
+int cebr_retire(void *ptr, cebr_free_fn *fn) {
+  if(fn == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cebr_retired_t *r = malloc(sizeof(cebr_retired_t));
+  if(r == NULL) return -1;
+  r->ptr = ptr;
+  r->fn = fn;
+
+  /* L'oggetto viene inserito nella lista del thread, senza contendersi
+     lock o linee di cache con gli altri thread */
+  cebr_record_t *rec = self != NULL ? self : acquire_record();
+  r->epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+  r->next = rec->limbo;
+  rec->limbo = r;
+
+  cebr_collect();
+  return 0;
+}
+
+void cebr_collect(void) {
+  cebr_record_t *rec = self != NULL ? self : acquire_record();
+
+  try_advance();
+  /* Gli oggetti vengono staccati dalla lista prima di essere deallocati,
+     le funzioni possono quindi ritirare altri oggetti */
+  free_retired(detach_expired(rec));
+}
+
+void cebr_flush(void) {
+  int found;
+  do {
+    /* Le funzioni di deallocazione possono ritirare altri oggetti, per cui
+       si ripete finché tutte le liste sono vuote */
+    found = 0;
+    for(cebr_record_t *rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE);
+        rec != NULL; rec = rec->next) {
+      cebr_retired_t *all = rec->limbo;
+      rec->limbo = NULL;
+      if(all != NULL) {
+        found = 1;
+        free_retired(all);
+      }
+    }
+  } while(found);
+}
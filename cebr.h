@@ -0,0 +1,78 @@
+/**
+ *  \file cebr.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Deallocazione differita basata su epoche
+ * Consente di leggere strutture dati condivise senza acquisire lock: chi
+ * legge racchiude l'accesso fra \ref cebr_enter e \ref cebr_exit, mentre chi
+ * rimuove un oggetto dalla struttura lo passa a \ref cebr_retire invece di
+ * deallocarlo. L'oggetto viene deallocato solo quando tutti i thread che
+ * potevano averlo letto sono usciti dalla propria sezione critica.
+ *
+ * Viene mantenuta un'epoca globale, e ogni thread registra l'epoca in cui è
+ * entrato nella sezione critica. L'epoca avanza solo quando tutti i thread
+ * in sezione critica hanno osservato quella corrente: un oggetto ritirato
+ * durante l'epoca e può essere deallocato quando l'epoca raggiunge e + 2.
+ * Ogni thread mantiene la propria lista di oggetti ritirati e dealloca
+ * solamente i propri, per cui nessun lock viene acquisito.
+ *
+ * Le sezioni critiche possono essere annidate, e vanno tenute brevi: finché
+ * un thread vi rimane, gli oggetti ritirati non vengono deallocati.
+ */
+
+#ifndef CEBR_H
+#define CEBR_H
+
+/**
+ * \brief Funzione che dealloca un oggetto ritirato
+ *
+ * \param ptr L'oggetto da deallocare
+ */
+typedef void(cebr_free_fn)(void *ptr);
+
+/**
+ * \brief Entra in una sezione critica di lettura
+ *
+ * Gli oggetti letti dopo l'ingresso non vengono deallocati prima della
+ * corrispondente \ref cebr_exit.
+ */
+void cebr_enter(void);
+
+/**
+ * \brief Esce da una sezione critica di lettura
+ */
+void cebr_exit(void);
+
+/**
+ * \brief Ritira un oggetto già reso irraggiungibile ai nuovi lettori, che
+ *        verrà deallocato quando non potrà più essere in uso
+ *
+ * Può essere chiamata anche all'interno di una sezione critica. Non attende
+ * mai: gli oggetti ritirati in precedenza dal thread chiamante e non più in
+ * uso vengono deallocati.
+ *
+ * \param ptr L'oggetto da ritirare
+ * \param fn La funzione con cui deallocarlo
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cebr_retire(void *ptr, cebr_free_fn *fn);
+
+/**
+ * \brief Dealloca gli oggetti ritirati dal thread chiamante che non possono
+ *        più essere in uso
+ */
+void cebr_collect(void);
+
+/**
+ * \brief Dealloca tutti gli oggetti ritirati
+ *
+ * Comprende gli oggetti ritirati dai thread già terminati. Va chiamata solo
+ * quando nessun altro thread usa le sezioni critiche o ritira oggetti, ad
+ * esempio alla terminazione del programma.
+ */
+void cebr_flush(void);
+
+#endif /* CEBR_H */
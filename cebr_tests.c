@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cebr.h"
+
+#define READERS 6
+#define WRITES 20000
+#define RETIRES 5000
+#define MAGIC 0x5ca1ab1e
+
+struct obj {
+  int magic;
+  int val;
+};
+
+struct obj *shared;
+int done = 0;
+long freed = 0;
+
+void free_obj(void *ptr) {
+  struct obj *o = (struct obj*)ptr;
+  assert(o->magic == MAGIC);
+  /* Un lettore che accedesse all'oggetto dopo la deallocazione se ne
+     accorgerebbe */
+  o->magic = 0;
+  __atomic_add_fetch(&freed, 1, __ATOMIC_RELAXED);
+  free(o);
+}
+
+void *reader(void *ud) {
+  while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+    cebr_enter();
+    struct obj *o = __atomic_load_n(&shared, __ATOMIC_ACQUIRE);
+    int val = o->val;
+
+    /* Sezione critica annidata */
+    cebr_enter();
+    assert(__atomic_load_n(&shared, __ATOMIC_ACQUIRE)->magic == MAGIC);
+    cebr_exit();
+
+    for(int i = 0; i < 100; i++) {
+      assert(o->magic == MAGIC && o->val == val);
+    }
+    cebr_exit();
+  }
+  return NULL;
+}
+
+void *retirer(void *ud) {
+  for(int i = 0; i < RETIRES; i++) {
+    struct obj *o = malloc(sizeof(struct obj));
+    o->magic = MAGIC;
+    o->val = i;
+
+    cebr_enter();
+    assert(cebr_retire(o, free_obj) == 0);
+    cebr_exit();
+  }
+  return NULL;
+}
+
+int main(void) {
+  shared = malloc(sizeof(struct obj));
+  shared->magic = MAGIC;
+  shared->val = 0;
+
+  pthread_t threads[READERS];
+  for(int i = 0; i < READERS; i++) {
+    pthread_create(threads + i, NULL, reader, NULL);
+  }
+
+  for(int i = 1; i <= WRITES; i++) {
+    struct obj *o = malloc(sizeof(struct obj));
+    o->magic = MAGIC;
+    o->val = i;
+    struct obj *old = __atomic_exchange_n(&shared, o, __ATOMIC_ACQ_REL);
+    assert(cebr_retire(old, free_obj) == 0);
+  }
+
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  for(int i = 0; i < READERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  /* Senza lettori gli oggetti ritirati vengono deallocati dopo due
+     avanzamenti dell'epoca */
+  cebr_collect();
+  cebr_collect();
+  cebr_collect();
+  assert(freed == WRITES);
+
+  /* Un oggetto ritirato all'interno di una sezione critica non viene
+     deallocato prima della sua fine */
+  cebr_enter();
+  assert(cebr_retire(shared, free_obj) == 0);
+  cebr_collect();
+  cebr_collect();
+  cebr_collect();
+  assert(freed == WRITES);
+  cebr_exit();
+
+  cebr_flush();
+  assert(freed == WRITES + 1);
+
+  /* Ogni thread ritira gli oggetti nella propria lista: quelli ancora in
+     attesa quando il thread termina vengono deallocati da cebr_flush */
+  for(int i = 0; i < READERS; i++) {
+    pthread_create(threads + i, NULL, retirer, NULL);
+  }
+  for(int i = 0; i < READERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  cebr_flush();
+  assert(freed == WRITES + 1 + READERS * RETIRES);
+  return 0;
+}
@@ -13,13 +13,38 @@
 #include <string.h>
 #include <errno.h>
 #include "chash.h"
+#include "cebr.h"
+#include "cslab.h"
 
-/// La dimensione di una hashtable
-#define NUM_HASH_ENTRIES 1024
+/// Numero di segmenti in cui è suddivisa una hashtable
+#define NUM_HASH_SEGMENTS 64
 
-#define NUM_HASH_CLUSTERS 64
+/// Numero di bit dell'hash usati per scegliere il segmento
+#define SEGMENT_BITS 6
 
-#define HASH_CLUSTER_SIZE ((NUM_HASH_ENTRIES)/(NUM_HASH_CLUSTERS))
+/// Numero minimo di slot di un segmento
+#define MIN_SEGMENT_SIZE 8
+
+/// Byte di controllo di uno slot mai occupato
+#define SLOT_EMPTY 0x00
+
+/// Byte di controllo di uno slot il cui elemento è stato eliminato
+#define SLOT_DELETED 0x01
+
+/// Bit impostato nel byte di controllo degli slot occupati
+#define SLOT_FULL 0x80
+
+/// Impronta di una chiave, memorizzata nel byte di controllo del suo slot
+#define FINGERPRINT(h) ((uint8_t)(SLOT_FULL | ((h) >> 57)))
+
+/// Lunghezza massima delle chiavi confrontate a parole di 64 bit
+#define INLINE_KEY_LENGTH 32
+
+/// Costanti moltiplicative della funzione di hash
+#define HASH_K1 0x9e3779b97f4a7c15ULL
+#define HASH_K2 0xc2b2ae3d27d4eb4fULL
+
+#define ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
 
 #define CHECK_RET if(ret != 0) { \
                     errno = ret; \
@@ -27,325 +52,506 @@
                   }
 
 /**
- * \brief Una lista di trabocco di una tabella hash
+ * \brief Un elemento della tabella
+ * 
+ * La chiave non cambia mai, mentre il valore viene letto e scritto in
+ * maniera atomica. Un elemento rimosso viene deallocato solo quando
+ * nessun lettore può più accedervi.
  */
-typedef struct chash_entry {
-  char *key; ///< Chiave del nodo
-  void *value; ///< Valore del nodo
-  struct chash_entry *next; ///< Nodo successivo
+typedef struct {
+  void *value; ///< Valore dell'elemento
+  uint64_t hash; ///< Hash completo della chiave
+  size_t len; ///< Lunghezza della chiave
+  char key[]; ///< Chiave dell'elemento
 } chash_entry_t;
 
+/**
+ * \brief Chiave cercata nella tabella, di cui lunghezza e hash vengono
+ *        calcolati una sola volta per ogni operazione
+ */
+typedef struct {
+  const char *str; ///< La chiave
+  size_t len; ///< Lunghezza della chiave
+  uint64_t hash; ///< Hash della chiave
+} chash_key_t;
+
+/**
+ * \brief Vettore degli slot di un segmento: una tabella ad indirizzamento
+ *        aperto con scansione lineare
+ * 
+ * Per ogni slot viene mantenuto un byte di controllo, in un vettore
+ * separato, che contiene un'impronta della chiave: durante una ricerca le
+ * chiavi vengono confrontate solo se l'impronta corrisponde, e i byte di
+ * controllo di molti slot consecutivi stanno nella stessa linea di cache.
+ * 
+ * Viene allocato con un'unica allocazione, e sostituito interamente
+ * quando il segmento cresce.
+ */
+typedef struct {
+  size_t cap; ///< Numero di slot, sempre una potenza di 2
+  chash_entry_t **slots; ///< Elementi contenuti negli slot
+  uint8_t *ctrl; ///< Byte di controllo degli slot
+} chash_table_t;
+
+/**
+ * \brief Segmento di una hashtable
+ * 
+ * Le letture accedono a \ref table senza acquisire il mutex, che serializza
+ * solamente le scritture.
+ */
+typedef struct {
+  pthread_mutex_t mtx; ///< Mutex per la modifica del segmento
+  chash_table_t *table; ///< Slot del segmento (accesso atomico)
+  size_t used; ///< Numero di slot occupati
+  size_t deleted; ///< Numero di slot eliminati
+} chash_segment_t;
+
+/**
+ * \brief Copia degli elementi di un segmento, usata per scandire la
+ *        tabella senza bloccarla
+ */
+typedef struct {
+  size_t n; ///< Numero di elementi copiati
+  size_t cap; ///< Dimensione dei vettori
+  chash_entry_t **entries; ///< Elementi copiati
+  void **values; ///< Valori degli elementi al momento della copia
+} chash_snapshot_t;
+
 /**
  * \brief Tabella hash concorrente
  */
 struct chash {
-  chash_entry_t *entries[NUM_HASH_ENTRIES]; ///< Tabella dei nodi
-  int numkeys; ///< Numero di nodi attualmente contenuti
-  pthread_mutex_t mutexes[NUM_HASH_CLUSTERS]; ///< Mutexes per l'accesso ai cluster
+  chash_segment_t segments[NUM_HASH_SEGMENTS]; ///< Segmenti della tabella
 };
 
-/* Da http://www.cse.yorku.ca/~oz/hash.html */
-static size_t hash(const char *str) {
-  size_t hash = 5381;
-  size_t c;
-
-  while ((c = *str++))
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-
-  return (size_t)(hash % NUM_HASH_ENTRIES);
+static uint64_t load64(const char *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
 }
 
-chash_t *chash_init() {
-  chash_t *ht = calloc(1, sizeof(chash_t));
-  if(ht == NULL) return NULL;
+static uint64_t load32(const char *p) {
+  uint32_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
 
-  memset(ht, 0, sizeof(chash_t));
-  for(int i = 0; i < NUM_HASH_CLUSTERS; i++) {
-    int ret = pthread_mutex_init(&(ht->mutexes[i]), NULL);
-    if(ret != 0) {
-      errno = ret;
-      return NULL;
+/* La chiave viene letta 16 byte alla volta, in due accumulatori
+   indipendenti. Gli ultimi byte vengono letti con letture che si
+   sovrappongono a quelle precedenti invece che uno alla volta, senza mai
+   uscire dalla chiave. Infine i bit vengono rimescolati in modo che sia il
+   segmento che l'impronta dipendano dall'intera chiave */
+static uint64_t hash(const char *str, size_t len) {
+  uint64_t a = HASH_K1 ^ len;
+  uint64_t b = HASH_K2;
+  uint64_t x, y;
+
+  if(len > 16) {
+    for(size_t i = 0; i + 16 < len; i += 16) {
+      a = ROTL((a ^ load64(str + i)) * HASH_K1, 31);
+      b = ROTL((b ^ load64(str + i + 8)) * HASH_K2, 29);
     }
+    x = load64(str + len - 16);
+    y = load64(str + len - 8);
+  } else if(len >= 8) {
+    x = load64(str);
+    y = load64(str + len - 8);
+  } else if(len >= 4) {
+    x = load32(str);
+    y = load32(str + len - 4);
+  } else if(len > 0) {
+    x = ((uint64_t)(unsigned char)str[0] << 16) |
+        ((uint64_t)(unsigned char)str[len >> 1] << 8) |
+        (uint64_t)(unsigned char)str[len - 1];
+    y = 0;
+  } else {
+    x = y = 0;
   }
+  a = ROTL((a ^ x) * HASH_K1, 31);
+  b = ROTL((b ^ y) * HASH_K2, 29);
+
+  uint64_t h = a ^ ROTL(b, 17);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
 
-  return ht;
+static void key_prepare(chash_key_t *k, const char *str) {
+  k->str = str;
+  k->len = strlen(str);
+  k->hash = hash(str, k->len);
 }
 
-int chash_get(chash_t *ht, const char *key, chash_get_callback cb, void *ud) {
-  if(cb == NULL || ht == NULL) {
-    errno = EINVAL;
-    return -1;
-  }
+/**
+ * \brief Confronta la chiave di un elemento con quella cercata: prima gli
+ *        hash completi, poi le chiavi corte una parola di 64 bit alla volta
+ */
+static int key_equals(const chash_entry_t *e, const chash_key_t *k) {
+  if(e->hash != k->hash || e->len != k->len) return 0;
 
-  size_t idx = hash(key);
-  pthread_mutex_t *mtx = &(ht->mutexes[idx / HASH_CLUSTER_SIZE]);
-  int ret = pthread_mutex_lock(mtx);
+  size_t len = k->len;
+  if(len < 8 || len > INLINE_KEY_LENGTH) return memcmp(e->key, k->str, len) == 0;
 
-  CHECK_RET
+  /* L'ultima parola si sovrappone alle precedenti se la lunghezza non è
+     un multiplo di 8 */
+  uint64_t diff = load64(e->key + len - 8) ^ load64(k->str + len - 8);
+  for(size_t i = 0; i + 8 < len; i += 8) {
+    diff |= load64(e->key + i) ^ load64(k->str + i);
+  }
+  return diff == 0;
+}
 
-  if(ht->entries[idx] == NULL) {
-    ret = pthread_mutex_unlock(mtx);
-    CHECK_RET
+/**
+ * \brief Alloca un elemento con la chiave \p k
+ * 
+ * \return chash_entry_t* NULL se non è stato possibile allocarlo
+ */
+static chash_entry_t *entry_alloc(const chash_key_t *k, void *value) {
+  chash_entry_t *e = cslab_alloc(sizeof(chash_entry_t) + k->len + 1);
+  if(e == NULL) return NULL;
+  e->value = value;
+  e->hash = k->hash;
+  e->len = k->len;
+  memcpy(e->key, k->str, k->len + 1);
+  return e;
+}
 
-    cb(key, NULL, ud);
-    return 0;
-  } else {
-    chash_entry_t *ptr = ht->entries[idx];
-    while(ptr != NULL && strcmp(ptr->key, key) != 0) {
-      ptr = ptr->next;
-    }
+/**
+ * \brief Restituisce il segmento a cui appartiene un hash
+ */
+static chash_segment_t *segment_of(chash_t *ht, uint64_t h) {
+  return &(ht->segments[h & (NUM_HASH_SEGMENTS - 1)]);
+}
 
-    if(ptr == NULL) {
-      ret = pthread_mutex_unlock(mtx);
-      CHECK_RET
+/**
+ * \brief Alloca un vettore di slot vuoti
+ * 
+ * \return chash_table_t* NULL se non è stato possibile allocarlo
+ */
+static chash_table_t *table_alloc(size_t cap) {
+  chash_table_t *t = calloc(1, sizeof(chash_table_t) + cap * (sizeof(chash_entry_t*) + 1));
+  if(t == NULL) return NULL;
+
+  t->cap = cap;
+  t->slots = (chash_entry_t**)(t + 1);
+  t->ctrl = (uint8_t*)(t->slots + cap);
+  return t;
+}
 
-      cb(key, NULL, ud);
-      return 0;
-    } else {
-      cb(key, ptr->value, ud);
+/**
+ * \brief Cerca una chiave in un vettore di slot. Può essere chiamata senza
+ *        il mutex del segmento, all'interno di una sezione critica
+ * 
+ * \param t Il vettore in cui cercare
+ * \param k La chiave da cercare
+ * \param idx Se non NULL, viene impostato all'indice dello slot trovato
+ * \return chash_entry_t* L'elemento con la chiave cercata, NULL se non presente
+ */
+static chash_entry_t *table_find(chash_table_t *t, const chash_key_t *k, size_t *idx) {
+  uint8_t fp = FINGERPRINT(k->hash);
+  size_t mask = t->cap - 1;
+  size_t i = (k->hash >> SEGMENT_BITS) & mask;
+
+  for(size_t n = 0; n < t->cap; n++, i = (i + 1) & mask) {
+    uint8_t ctrl = __atomic_load_n(&(t->ctrl[i]), __ATOMIC_ACQUIRE);
+    if(ctrl == SLOT_EMPTY) return NULL;
+    if(ctrl == fp) {
+      /* Lo slot potrebbe essere stato svuotato o riutilizzato nel
+         frattempo, per cui va confrontata la chiave dell'elemento letto */
+      chash_entry_t *e = __atomic_load_n(&(t->slots[i]), __ATOMIC_ACQUIRE);
+      if(e != NULL && key_equals(e, k)) {
+        if(idx != NULL) *idx = i;
+        return e;
+      }
     }
+  }
+  return NULL;
+}
 
+/**
+ * \brief Inserisce un elemento in uno slot libero. Va chiamata con il mutex
+ *        del segmento acquisito, e il vettore deve avere almeno uno slot mai
+ *        occupato
+ * 
+ * \return int 1 se è stato occupato uno slot eliminato, 0 altrimenti
+ */
+static int table_place(chash_table_t *t, chash_entry_t *e) {
+  size_t mask = t->cap - 1;
+  size_t i = (e->hash >> SEGMENT_BITS) & mask;
+
+  while(t->ctrl[i] & SLOT_FULL) {
+    i = (i + 1) & mask;
   }
-  ret = pthread_mutex_unlock(mtx);
-  CHECK_RET
 
-  return 0;
+  int reused = t->ctrl[i] == SLOT_DELETED;
+  /* L'elemento deve essere visibile prima dell'impronta */
+  __atomic_store_n(&(t->slots[i]), e, __ATOMIC_RELEASE);
+  __atomic_store_n(&(t->ctrl[i]), FINGERPRINT(e->hash), __ATOMIC_RELEASE);
+  return reused;
 }
 
-static int chash_lock_all(chash_t *ht) {
-  for(int i = 0; i < NUM_HASH_CLUSTERS; i++) {
-    int ret = pthread_mutex_lock(&(ht->mutexes[i]));
-    CHECK_RET
+/**
+ * \brief Prepara un segmento all'inserimento di un nuovo elemento. Va
+ *        chiamata con il mutex del segmento acquisito
+ * 
+ * Quando gli slot non liberi superano i 3/4 del totale, il vettore degli
+ * slot viene ricostruito: se gli elementi presenti occupano più di metà
+ * degli slot la sua dimensione viene raddoppiata, altrimenti vengono solo
+ * eliminati gli slot marcati come eliminati. Gli altri segmenti non vengono
+ * toccati. Il nuovo vettore sostituisce il precedente in maniera atomica, e
+ * il precedente viene deallocato quando nessun lettore può più accedervi.
+ * 
+ * \return int 0 in caso di successo, -1 altrimenti
+ */
+static int segment_reserve(chash_segment_t *seg) {
+  chash_table_t *old = seg->table;
+  if((seg->used + seg->deleted + 1) * 4 <= old->cap * 3) return 0;
+
+  size_t newCap = old->cap;
+  if((seg->used + 1) * 2 > old->cap) newCap *= 2;
+
+  chash_table_t *t = table_alloc(newCap);
+  if(t == NULL) return -1;
+
+  /* Gli elementi vengono condivisi fra i due vettori, e il loro hash non
+     va ricalcolato */
+  for(size_t i = 0; i < old->cap; i++) {
+    if(old->ctrl[i] & SLOT_FULL) {
+      table_place(t, old->slots[i]);
+    }
   }
 
-  return 0;
+  __atomic_store_n(&(seg->table), t, __ATOMIC_RELEASE);
+  seg->deleted = 0;
+  return cebr_retire(old, free);
 }
 
-static int chash_unlock_all(chash_t *ht) {
-  for(int i = 0; i < NUM_HASH_CLUSTERS; i++) {
-    int ret = pthread_mutex_unlock(&(ht->mutexes[i]));
-    CHECK_RET
+/**
+ * \brief Rimuove l'elemento contenuto in uno slot. Va chiamata con il mutex
+ *        del segmento acquisito
+ * 
+ * \return int 0 in caso di successo, -1 altrimenti
+ */
+static int segment_remove(chash_segment_t *seg, size_t idx) {
+  chash_table_t *t = seg->table;
+  chash_entry_t *e = t->slots[idx];
+
+  /* Se lo slot successivo non è mai stato occupato, nessuna ricerca
+     prosegue oltre questo slot, che può quindi tornare libero */
+  if(t->ctrl[(idx + 1) & (t->cap - 1)] == SLOT_EMPTY) {
+    __atomic_store_n(&(t->ctrl[idx]), SLOT_EMPTY, __ATOMIC_RELEASE);
+  } else {
+    __atomic_store_n(&(t->ctrl[idx]), SLOT_DELETED, __ATOMIC_RELEASE);
+    seg->deleted++;
   }
+  __atomic_store_n(&(t->slots[idx]), NULL, __ATOMIC_RELEASE);
+  seg->used--;
 
-  return 0;
+  return cebr_retire(e, cslab_free);
 }
 
-int chash_get_all(chash_t *ht, chash_get_callback cb, void *ud) {
-  if(cb == NULL || ht == NULL) {
-    errno = EINVAL;
-    return -1;
+chash_t *chash_init(size_t capacity) {
+  chash_t *ht = calloc(1, sizeof(chash_t));
+  if(ht == NULL) return NULL;
+
+  /* Ogni segmento viene dimensionato in modo da contenere la sua parte
+     degli elementi previsti occupando al più metà degli slot */
+  size_t segCap = MIN_SEGMENT_SIZE;
+  while(segCap < 2 * (capacity / NUM_HASH_SEGMENTS + 1)) {
+    segCap *= 2;
   }
 
-  int ret = chash_lock_all(ht);
-  CHECK_RET
+  for(int i = 0; i < NUM_HASH_SEGMENTS; i++) {
+    chash_segment_t *seg = &(ht->segments[i]);
+    int ret = pthread_mutex_init(&(seg->mtx), NULL);
+    if(ret == 0) {
+      seg->table = table_alloc(segCap);
+      if(seg->table == NULL) {
+        pthread_mutex_destroy(&(seg->mtx));
+        ret = ENOMEM;
+      }
+    }
 
-  for(size_t i = 0; i < NUM_HASH_ENTRIES; i++) {
-    if(ht->entries[i] != NULL) {
-      chash_entry_t *ptr = ht->entries[i];
-      while(ptr != NULL) {
-        cb(ptr->key, ptr->value, ud);
-        ptr = ptr->next;
+    if(ret != 0) {
+      for(int j = 0; j < i; j++) {
+        pthread_mutex_destroy(&(ht->segments[j].mtx));
+        free(ht->segments[j].table);
       }
+      free(ht);
+      errno = ret;
+      return NULL;
     }
   }
 
-  ret = chash_unlock_all(ht);
-  CHECK_RET
-  return 0;
+  return ht;
 }
 
-int chash_set(chash_t *table, const char *key, void *value, void **oldValue) {
-  if(table == NULL) {
+int chash_get(chash_t *ht, const char *key, chash_get_callback cb, void *ud) {
+  if(cb == NULL || ht == NULL || key == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  size_t idx = hash(key);
-  size_t keyLen = strlen(key);
-  pthread_mutex_t *mtx = &(table->mutexes[idx / HASH_CLUSTER_SIZE]);
-  int ret = pthread_mutex_lock(mtx);
-  CHECK_RET
-  if(table->entries[idx] == NULL) {
-    if(value == NULL) {
-      goto end;
-    }
-    chash_entry_t *newEntry = calloc(1, sizeof(chash_entry_t));
-    if(newEntry == NULL) {
-      ret = pthread_mutex_unlock(mtx);
-      if(ret != 0) {
-        errno = ret;
-      }
-      return -1;
-    }
-
-    newEntry->key = calloc(keyLen + 1, sizeof(char));
-    if(newEntry->key == NULL) {
-      ret = pthread_mutex_unlock(mtx);
-      if(ret != 0) {
-        errno = ret;
-      }
-      return -1;
-    }
-
-    strncpy(newEntry->key, key, keyLen);
-    newEntry->value = value;
-    newEntry->next = NULL;
+  chash_key_t k;
+  key_prepare(&k, key);
+  chash_segment_t *seg = segment_of(ht, k.hash);
 
-    table->entries[idx] = newEntry;
-    table->numkeys++;
+  /* Nessun lock: gli elementi e i vettori letti restano validi fino
+     all'uscita dalla sezione critica */
+  cebr_enter();
+  chash_table_t *t = __atomic_load_n(&(seg->table), __ATOMIC_ACQUIRE);
+  chash_entry_t *e = table_find(t, &k, NULL);
+  void *value = e == NULL ? NULL : __atomic_load_n(&(e->value), __ATOMIC_ACQUIRE);
 
-    if(oldValue != NULL) *oldValue = NULL;
+  cb(key, value, ud);
+  cebr_exit();
 
-  } else {
-    chash_entry_t  *prev = NULL;
-    chash_entry_t *ptr = table->entries[idx];
-    while(ptr != NULL && strcmp(ptr->key, key) != 0) {
-      prev = ptr;
-      ptr = ptr->next;
-    }
+  return 0;
+}
 
-    if(ptr == NULL) {
-      if(value == NULL) {
-        goto end;
-      }
-      
-      chash_entry_t *newEntry = malloc(sizeof(chash_entry_t));
-      if(newEntry == NULL) {
-        ret = pthread_mutex_unlock(mtx);
-        CHECK_RET
-        return -1;
-      }
+/**
+ * \brief Copia gli elementi presenti in un segmento e i loro valori,
+ *        acquisendo il mutex del segmento solo per il tempo della copia.
+ *        Va chiamata all'interno di una sezione critica, fino al termine
+ *        della quale gli elementi copiati restano validi
+ * 
+ * \param seg Il segmento da copiare
+ * \param snap La copia, i cui vettori vengono ingranditi se necessario
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+static int segment_snapshot(chash_segment_t *seg, chash_snapshot_t *snap) {
+  int ret = pthread_mutex_lock(&(seg->mtx));
+  CHECK_RET
 
-      newEntry->key = calloc(keyLen + 1, sizeof(char));
-      if(newEntry->key == NULL) {
-        ret = pthread_mutex_unlock(mtx);
-        CHECK_RET
-        return -1;
-      }
-      
-      strncpy(newEntry->key, key, keyLen);
-      newEntry->value = value;
-      newEntry->next = table->entries[idx];
+  if(snap->cap < seg->used) {
+    chash_entry_t **entries = realloc(snap->entries, seg->used * sizeof(chash_entry_t*));
+    if(entries != NULL) snap->entries = entries;
+    void **values = realloc(snap->values, seg->used * sizeof(void*));
+    if(values != NULL) snap->values = values;
 
-      table->entries[idx] = newEntry;
-      table->numkeys++;
+    if(entries == NULL || values == NULL) {
+      pthread_mutex_unlock(&(seg->mtx));
+      errno = ENOMEM;
+      return -1;
+    }
+    snap->cap = seg->used;
+  }
 
-      if(oldValue != NULL) *oldValue = NULL;
-    } else {
-      if(oldValue != NULL) *oldValue = ptr->value;
-      if(value == NULL) {
-        if(prev == NULL) {
-          table->entries[idx] = ptr->next;
-        } else {
-          prev->next = ptr->next;
-        }
-        free(ptr->key);
-        free(ptr);
-        table->numkeys--;
-      } else {
-        ptr->value = value;
-      }
+  chash_table_t *t = seg->table;
+  snap->n = 0;
+  for(size_t i = 0; i < t->cap; i++) {
+    if(t->ctrl[i] & SLOT_FULL) {
+      snap->entries[snap->n] = t->slots[i];
+      snap->values[snap->n] = t->slots[i]->value;
+      snap->n++;
     }
   }
 
-end:
-  ret = pthread_mutex_unlock(mtx);
+  ret = pthread_mutex_unlock(&(seg->mtx));
   CHECK_RET
   return 0;
 }
 
-int chash_set_if_empty(chash_t *table, const char *key, void *value) {
-  if(table == NULL) {
+static void snapshot_free(chash_snapshot_t *snap) {
+  free(snap->entries);
+  free(snap->values);
+}
+
+int chash_get_all(chash_t *ht, chash_get_callback cb, void *ud) {
+  if(cb == NULL || ht == NULL) {
     errno = EINVAL;
     return -1;
   }
 
-  size_t idx = hash(key);
-  size_t keyLen = strlen(key);
-  pthread_mutex_t *mtx = &(table->mutexes[idx / HASH_CLUSTER_SIZE]);
-  int ret = pthread_mutex_lock(mtx);
-  CHECK_RET
-  if(table->entries[idx] == NULL) {
-    if(value == NULL) {
-      goto end;
-    }
-    chash_entry_t *newEntry = calloc(1, sizeof(chash_entry_t));
-    if(newEntry == NULL) {
-      ret = pthread_mutex_unlock(mtx);
-      if(ret != 0) {
-        errno = ret;
-      }
+  chash_snapshot_t snap;
+  memset(&snap, 0, sizeof(snap));
+
+  /* I segmenti vengono copiati uno alla volta, e le callback vengono
+     chiamate senza alcun lock */
+  for(int i = 0; i < NUM_HASH_SEGMENTS; i++) {
+    cebr_enter();
+    if(segment_snapshot(&(ht->segments[i]), &snap) != 0) {
+      int err = errno;
+      cebr_exit();
+      snapshot_free(&snap);
+      errno = err;
       return -1;
     }
 
-    newEntry->key = calloc(keyLen + 1, sizeof(char));
-    if(newEntry->key == NULL) {
-      ret = pthread_mutex_unlock(mtx);
-      if(ret != 0) {
-        errno = ret;
-      }
-      return -1;
+    for(size_t j = 0; j < snap.n; j++) {
+      cb(snap.entries[j]->key, snap.values[j], ud);
     }
+    cebr_exit();
+  }
 
-    strncpy(newEntry->key, key, keyLen);
-    newEntry->value = value;
-    newEntry->next = NULL;
+  snapshot_free(&snap);
+  return 0;
+}
 
-    table->entries[idx] = newEntry;
-    table->numkeys++;
-  } else {
-    chash_entry_t *ptr = table->entries[idx];
-    while(ptr != NULL && strcmp(ptr->key, key) != 0) {
-      ptr = ptr->next;
-    }
+/**
+ * \brief Imposta un valore nella hashtable
+ * 
+ * \param table La hashtable in cui impostare il valore
+ * \param key La chiave a cui impostare il valore
+ * \param value Il valore da impostare, NULL per eliminare quello presente
+ * \param oldValue Il vecchio valore presente con la stessa chiave (opzionale)
+ * \param replace 0 se un valore già presente non va sostituito
+ * \return int 0 se il valore è stato impostato, 1 se era già presente e
+ *             \p replace è 0, -1 ed errno impostato in caso di errore
+ */
+static int chash_put(chash_t *table, const char *key, void *value, void **oldValue, int replace) {
+  if(table == NULL || key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-    if(ptr == NULL) {
-      if(value == NULL) {
-        goto end;
-      }
-      
-      chash_entry_t *newEntry = calloc(1, sizeof(chash_entry_t));
-      if(newEntry == NULL) {
-        ret = pthread_mutex_unlock(mtx);
-        CHECK_RET
-        return -1;
-      }
+  chash_key_t k;
+  key_prepare(&k, key);
+  chash_segment_t *seg = segment_of(table, k.hash);
+  int ret = pthread_mutex_lock(&(seg->mtx));
+  CHECK_RET
 
-      newEntry->key = calloc(keyLen + 1, sizeof(char));
-      if(newEntry->key == NULL) {
-        ret = pthread_mutex_unlock(mtx);
-        CHECK_RET
-        return -1;
-      }
-      strncpy(newEntry->key, key, keyLen);
+  int res = 0;
+  size_t idx;
+  chash_entry_t *e = table_find(seg->table, &k, &idx);
+  if(oldValue != NULL) *oldValue = e == NULL ? NULL : e->value;
 
-      newEntry->value = value;
-      newEntry->next = table->entries[idx];
-      
-      table->entries[idx] = newEntry;
-      table->numkeys++;
+  if(e != NULL) {
+    if(!replace) {
+      res = 1;
+    } else if(value == NULL) {
+      res = segment_remove(seg, idx);
     } else {
-      ret = pthread_mutex_unlock(mtx);
+      __atomic_store_n(&(e->value), value, __ATOMIC_RELEASE);
+    }
+  } else if(value != NULL) {
+    e = entry_alloc(&k, value);
+    if(e == NULL || segment_reserve(seg) != 0) {
+      int err = errno;
+      cslab_free(e);
+      ret = pthread_mutex_unlock(&(seg->mtx));
       CHECK_RET
-      return 1;
+      errno = err;
+      return -1;
     }
+    if(table_place(seg->table, e)) seg->deleted--;
+    seg->used++;
   }
 
-end:
-  ret = pthread_mutex_unlock(mtx);
+  ret = pthread_mutex_unlock(&(seg->mtx));
   CHECK_RET
-  return 0;
+  return res;
 }
 
-static int deinit_elem(chash_entry_t *elem, chash_deinitializer cb) {
-  if(elem->next != NULL) {
-    deinit_elem(elem->next, cb);
-  }
+int chash_set(chash_t *table, const char *key, void *value, void **oldValue) {
+  return chash_put(table, key, value, oldValue, 1);
+}
 
-  free(elem->key);
-  cb(elem->value);
-  free(elem);
-  return 0;
+int chash_set_if_empty(chash_t *table, const char *key, void *value) {
+  return chash_put(table, key, value, NULL, 0);
 }
 
 int chash_deinit(chash_t *table, chash_deinitializer cb) {
@@ -354,24 +560,27 @@ int chash_deinit(chash_t *table, chash_deinitializer cb) {
     return -1;
   }
 
-  for(size_t i = 0; i < NUM_HASH_ENTRIES; i++) {
-    if(table->entries[i] != NULL) {
-      if(deinit_elem(table->entries[i], cb) != 0) {
-        return -1;
+  int err = 0;
+  for(int i = 0; i < NUM_HASH_SEGMENTS; i++) {
+    chash_segment_t *seg = &(table->segments[i]);
+    chash_table_t *t = seg->table;
+    for(size_t j = 0; j < t->cap; j++) {
+      if(t->ctrl[j] & SLOT_FULL) {
+        if(cb != NULL) cb(t->slots[j]->value);
+        cslab_free(t->slots[j]);
       }
     }
+    free(t);
+
+    int ret = pthread_mutex_destroy(&(seg->mtx));
+    if(ret != 0) err = ret;
   }
-  for(int i = 0; i < NUM_HASH_CLUSTERS; i++) {
-    int ret = pthread_mutex_destroy(&(table->mutexes[i]));
-    if(ret != 0) {
-      errno = ret;
-      free(table);
-      return -1;
-    }
-  }
-  
-  
+
   free(table);
+  if(err != 0) {
+    errno = err;
+    return -1;
+  }
   return 0;
 }
 
@@ -381,33 +590,48 @@ int chash_keys(chash_t *ht, char ***keys) {
     return -1;
   }
 
-  int ret = chash_lock_all(ht);
-  CHECK_RET
+  chash_snapshot_t snap;
+  memset(&snap, 0, sizeof(snap));
+  char **arr = NULL;
+  size_t numkeys = 0;
 
-  int numkeys = ht->numkeys;
+  for(int i = 0; i < NUM_HASH_SEGMENTS; i++) {
+    cebr_enter();
+    int ret = segment_snapshot(&(ht->segments[i]), &snap);
 
-  *keys = calloc(numkeys, sizeof(char **));
-  if(*keys == NULL) {
-    return -1;
-  }
-  int j = 0;
-  char **arr = *keys;
-
-  for(size_t i = 0; i < NUM_HASH_ENTRIES; i++) {
-    if(ht->entries[i] != NULL) {
-      chash_entry_t *ptr = ht->entries[i];
-      while(ptr != NULL) {
-        size_t len = strlen(ptr->key);
-        arr[j] = calloc(len + 1, sizeof(char));
-        strncpy(arr[j], ptr->key, len);
-        j++;
-
-        ptr = ptr->next;
+    char **newArr = NULL;
+    if(ret == 0 && snap.n > 0) {
+      newArr = realloc(arr, (numkeys + snap.n) * sizeof(char *));
+      if(newArr == NULL) {
+        ret = -1;
+      } else {
+        arr = newArr;
+      }
+    }
+
+    for(size_t j = 0; ret == 0 && j < snap.n; j++) {
+      size_t len = snap.entries[j]->len;
+      arr[numkeys] = malloc(len + 1);
+      if(arr[numkeys] == NULL) {
+        ret = -1;
+      } else {
+        memcpy(arr[numkeys], snap.entries[j]->key, len + 1);
+        numkeys++;
       }
     }
+    cebr_exit();
+
+    if(ret != 0) {
+      int err = errno;
+      for(size_t l = 0; l < numkeys; l++) free(arr[l]);
+      free(arr);
+      snapshot_free(&snap);
+      errno = err;
+      return -1;
+    }
   }
 
-  ret = chash_unlock_all(ht);
-  CHECK_RET
+  snapshot_free(&snap);
+  *keys = arr;
   return numkeys;
-}
\ No newline at end of file
+}
@@ -7,16 +7,37 @@
  * 
  * \brief Hashtable concorrente
  * 
- * L'hashtable è implementata tramite liste di trabocco.
- * L'accesso concorrente alla tabella è consentito nel caso in cui si tenti
- * di leggere le chiavi presenti (o il loro numero) o si acceda ad elementi
- * con chiavi separate. La scrittura della tabella è bloccante.
- * La funzione di hash è stata presa da http://www.cse.yorku.ca/~oz/hash.html
+ * L'hashtable è suddivisa in segmenti, ognuno dei quali è una tabella ad
+ * indirizzamento aperto protetta da un proprio mutex. Ogni segmento cresce
+ * indipendentemente dagli altri quando si riempie, per cui l'inserimento di
+ * un elemento non richiede mai di ricostruire l'intera tabella.
+ * 
+ * La lettura di un elemento (\ref chash_get) non acquisisce alcun lock, e
+ * può quindi avvenire in parallelo con qualsiasi altra operazione: gli
+ * elementi rimossi e i vettori sostituiti vengono deallocati tramite
+ * \ref cebr_retire. Le scritture sono serializzate per segmento.
+ * 
+ * \ref chash_get_all e \ref chash_keys non bloccano la tabella: ogni
+ * segmento viene copiato con il suo mutex acquisito solo per il tempo della
+ * copia, per cui gli elementi visitati di uno stesso segmento rispecchiano
+ * il suo stato in un singolo istante. Un elemento presente per tutta la
+ * durata della scansione viene visitato esattamente una volta, mentre gli
+ * elementi inseriti o rimossi nel frattempo possono essere visitati o meno.
+ * 
+ * I valori rimossi o sostituiti possono essere ancora in uso da letture
+ * concorrenti: vanno deallocati anch'essi tramite \ref cebr_retire.
+ * 
+ * La funzione di hash legge le chiavi una parola di 64 bit alla volta, e
+ * ogni elemento ne memorizza l'hash completo, che viene confrontato prima
+ * della chiave. Le chiavi lunghe al più 32 byte, come i nickname, vengono
+ * confrontate parola per parola.
  */
 
 #ifndef CHASH_H_
 #define CHASH_H_
 
+#include <stddef.h>
+
 /// Tabella hash concorrente
 typedef struct chash chash_t;
 
@@ -40,9 +61,12 @@ typedef void(chash_get_callback)(const char *key, void *value, void *ud);
 /**
  * \brief Inizializza una hashtable concorrente
  * 
+ * \param capacity Numero di elementi che la tabella può contenere prima di
+ *                 dover crescere. La tabella cresce comunque in base al
+ *                 numero di elementi inseriti
  * \return chash_t* Viene restituito NULL e errno viene impostato se la funzione fallisce 
  */
-chash_t *chash_init();
+chash_t *chash_init(size_t capacity);
 
 /**
  * \brief Deinizializza una hashtable concorrente
@@ -59,7 +83,8 @@ int chash_deinit(chash_t *table, chash_deinitializer cb);
  * \param table La hashtable da cui ottenere il valore
  * \param key La chiave del valore da ottenere
  * \param cb La funzione che viene chiamata una volta che l'elemento è stato ottenuto. Non può essere NULL.
- *           ATTENZIONE: un tentativo di accesso allo stesso elemento della tabella da questa callback causa deadlock
+ *           Viene eseguita all'interno di una sezione critica di \ref cebr_enter, senza lock: chiamate
+ *           concorrenti sulla stessa chiave possono eseguirla in parallelo
  * \param ud Un valore scelto dall'utente da passare alla callback
  * \return int 0 se non si sono verificati errori, -1 altrimenti. Viene impostato errno se si è verificato un errore
  */
@@ -69,8 +94,8 @@ int chash_get(chash_t *table, const char *key, chash_get_callback cb, void *ud);
  * \brief Ottiene tutti i valori presenti nella hashtable
  * 
  * \param table La hashtable da scandire
- * \param cb La callback da chiamare su ogni valore presente.
- *           ATTENZIONE: non è possibile accedere ulteriormente alla stessa hashtable dall'interno di questa callback
+ * \param cb La callback da chiamare su ogni valore presente. Viene eseguita senza lock, all'interno di
+ *           una sezione critica di \ref cebr_enter, e può accedere alla stessa hashtable anche in scrittura
  * \param ud Un valore scelto dall'utente da passare alla callback
  * \return int 0 se non si sono verificati errori, -1 altrimenti. Viene impostato errno se si è verificato un errore
  */
@@ -0,0 +1,201 @@
+/**
+ *  \file chash_bench.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *  \brief Microbenchmark delle ricerche nella hashtable
+ *
+ * Confronta il tempo di una ricerca in \ref chash con quello della tabella
+ * usata in precedenza: liste di trabocco in una tabella di 1024 posizioni,
+ * hash djb2 calcolato un byte alla volta e chiavi allocate separatamente
+ * e confrontate con strcmp, con un mutex per ogni gruppo di 16 posizioni.
+ *
+ * Le chiavi sono simili a dei nickname, e vengono cercate sia chiavi
+ * presenti che chiavi assenti.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "chash.h"
+#include "config.h"
+
+/// Dimensione della tabella di riferimento
+#define REF_ENTRIES 1024
+
+/// Numero di mutex della tabella di riferimento
+#define REF_CLUSTERS 64
+
+/**
+ * \brief Nodo di una lista di trabocco della tabella di riferimento
+ */
+typedef struct ref_entry {
+  char *key; ///< Chiave del nodo
+  void *value; ///< Valore del nodo
+  struct ref_entry *next; ///< Nodo successivo
+} ref_entry_t;
+
+/**
+ * \brief Tabella di riferimento
+ */
+typedef struct {
+  ref_entry_t *entries[REF_ENTRIES]; ///< Tabella dei nodi
+  pthread_mutex_t mutexes[REF_CLUSTERS]; ///< Mutex dei cluster
+} ref_table_t;
+
+/// Evita che il compilatore elimini le ricerche
+static volatile long found = 0;
+
+static size_t ref_hash(const char *str) {
+  size_t hash = 5381;
+  size_t c;
+
+  while((c = *str++))
+    hash = ((hash << 5) + hash) + c;
+
+  return hash % REF_ENTRIES;
+}
+
+static void ref_put(ref_table_t *t, const char *key, void *value) {
+  size_t idx = ref_hash(key);
+  ref_entry_t *e = malloc(sizeof(ref_entry_t));
+  size_t len = strlen(key);
+  if(e == NULL || (e->key = malloc(len + 1)) == NULL) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(e->key, key, len + 1);
+  e->value = value;
+  e->next = t->entries[idx];
+  t->entries[idx] = e;
+}
+
+static void ref_get(ref_table_t *t, const char *key) {
+  size_t idx = ref_hash(key);
+  pthread_mutex_t *mtx = &(t->mutexes[idx / (REF_ENTRIES / REF_CLUSTERS)]);
+
+  pthread_mutex_lock(mtx);
+  ref_entry_t *ptr = t->entries[idx];
+  while(ptr != NULL && strcmp(ptr->key, key) != 0) {
+    ptr = ptr->next;
+  }
+  if(ptr != NULL) found++;
+  pthread_mutex_unlock(mtx);
+}
+
+static void get_cb(const char *key, void *value, void *ud) {
+  if(value != NULL) found++;
+}
+
+/**
+ * \brief Restituisce il tempo corrente in microsecondi
+ */
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void usage(const char *progname) {
+  fprintf(stderr, "Usa: %s [-k chiavi] [-n ricerche]\n", progname);
+}
+
+/**
+ * \brief Stampa il tempo medio di una ricerca
+ */
+static void report(const char *what, double elapsed, long lookups) {
+  printf("  %-24s %8.1f ns/ricerca\n", what, elapsed * 1e3 / lookups);
+}
+
+/** Funzione d'entrata */
+int main(int argc, char *argv[]) {
+  int numKeys = 10000;
+  long lookups = 5000000;
+
+  int opt;
+  while((opt = getopt(argc, argv, "k:n:")) != -1) {
+    switch(opt) {
+    case 'k': numKeys = atoi(optarg); break;
+    case 'n': lookups = atol(optarg); break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if(numKeys <= 0 || lookups <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  /* Le chiavi presenti e quelle assenti hanno la stessa forma */
+  char (*present)[MAX_NAME_LENGTH + 1] = calloc(numKeys, MAX_NAME_LENGTH + 1);
+  char (*absent)[MAX_NAME_LENGTH + 1] = calloc(numKeys, MAX_NAME_LENGTH + 1);
+  ref_table_t *ref = calloc(1, sizeof(ref_table_t));
+  chash_t *ht = chash_init(numKeys);
+  if(present == NULL || absent == NULL || ref == NULL || ht == NULL) {
+    perror("init");
+    return -1;
+  }
+  for(int i = 0; i < REF_CLUSTERS; i++) {
+    pthread_mutex_init(&(ref->mutexes[i]), NULL);
+  }
+
+  for(int i = 0; i < numKeys; i++) {
+    snprintf(present[i], MAX_NAME_LENGTH + 1, "utente_%d", i);
+    snprintf(absent[i], MAX_NAME_LENGTH + 1, "ospite_%d", i);
+    ref_put(ref, present[i], present[i]);
+    if(chash_set(ht, present[i], present[i], NULL) != 0) {
+      perror("chash_set");
+      return -1;
+    }
+  }
+
+  printf("Chiavi: %d, ricerche: %ld\n", numKeys, lookups);
+
+  double t0 = now_us();
+  for(long i = 0; i < lookups; i++) ref_get(ref, present[i % numKeys]);
+  report("djb2/strcmp presenti", now_us() - t0, lookups);
+
+  t0 = now_us();
+  for(long i = 0; i < lookups; i++) chash_get(ht, present[i % numKeys], get_cb, NULL);
+  report("chash presenti", now_us() - t0, lookups);
+
+  t0 = now_us();
+  for(long i = 0; i < lookups; i++) ref_get(ref, absent[i % numKeys]);
+  report("djb2/strcmp assenti", now_us() - t0, lookups);
+
+  t0 = now_us();
+  for(long i = 0; i < lookups; i++) chash_get(ht, absent[i % numKeys], get_cb, NULL);
+  report("chash assenti", now_us() - t0, lookups);
+
+  if(found != 2 * lookups) {
+    fprintf(stderr, "Risultati delle ricerche errati\n");
+    return -1;
+  }
+
+  for(int i = 0; i < REF_ENTRIES; i++) {
+    ref_entry_t *e = ref->entries[i];
+    while(e != NULL) {
+      ref_entry_t *next = e->next;
+      free(e->key);
+      free(e);
+      e = next;
+    }
+  }
+  for(int i = 0; i < REF_CLUSTERS; i++) {
+    pthread_mutex_destroy(&(ref->mutexes[i]));
+  }
+  free(ref);
+  chash_deinit(ht, NULL);
+  free(present);
+  free(absent);
+  return 0;
+}
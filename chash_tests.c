@@ -1,9 +1,14 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 #include <pthread.h>
 #include "chash.h"
 
+#define THREADS 8
+#define KEYS_PER_THREAD 20000
+
 struct arg {
   const char *key;
   int val;
@@ -19,6 +24,11 @@ void *func_1(void *ud) {
 }
 
 void func_2(const char *key, void *val, void *ud) {
+  /* La callback può modificare la tabella che sta scandendo */
+  assert(chash_set((chash_t*)ud, key, NULL, NULL) == 0);
+}
+
+void func_3(const char *key, void *val, void *ud) {
   const char **keys = (const char**)ud;
   for(int i = 0; i < 8; i++) {
     if(strcmp(key, keys[i]) == 0) {
@@ -29,8 +39,89 @@ void func_2(const char *key, void *val, void *ud) {
   assert(0);
 }
 
+struct grow_arg {
+  chash_t *ht;
+  int id;
+};
+
+void *func_4(void *ud) {
+  struct grow_arg *a = (struct grow_arg*)ud;
+  char key[32];
+
+  /* Inserisce abbastanza chiavi da far crescere tutti i segmenti */
+  for(int i = 0; i < KEYS_PER_THREAD; i++) {
+    sprintf(key, "utente %d-%d", a->id, i);
+    assert(chash_set_if_empty(a->ht, key, (void*)(intptr_t)(i + 1)) == 0);
+    assert(chash_set_if_empty(a->ht, key, (void*)(intptr_t)(i + 1)) == 1);
+  }
+
+  /* Elimina metà delle chiavi */
+  for(int i = 0; i < KEYS_PER_THREAD; i += 2) {
+    void *oldVal;
+    sprintf(key, "utente %d-%d", a->id, i);
+    assert(chash_set(a->ht, key, NULL, &oldVal) == 0);
+    assert((intptr_t)oldVal == i + 1);
+  }
+  return NULL;
+}
+
+void func_5(const char *key, void *val, void *ud) {
+  int i = *(int*)ud;
+  if(i % 2 == 0) {
+    assert(val == NULL);
+  } else {
+    assert((intptr_t)val == i + 1);
+  }
+}
+
+#define STABLE_KEYS 1000
+
+#define MAX_KEY_LEN 40
+
+void func_6(const char *key, void *val, void *ud) {
+  assert((intptr_t)val == *(intptr_t*)ud);
+}
+
+int growing = 1;
+
+void func_7(const char *key, void *val, void *ud) {
+  /* Le chiavi mai rimosse vengono sempre trovate, anche mentre i
+     segmenti crescono */
+  assert((intptr_t)val == *(int*)ud + 1);
+}
+
+void func_8(const char *key, void *val, void *ud) {
+  if(strncmp(key, "fisso ", 6) == 0) {
+    int i = atoi(key + 6);
+    assert((intptr_t)val == i + 1);
+    ((int*)ud)[i]++;
+  }
+}
+
+void *func_9(void *ud) {
+  chash_t *ht = (chash_t*)ud;
+  char key[32];
+  int seen[STABLE_KEYS];
+
+  while(__atomic_load_n(&growing, __ATOMIC_ACQUIRE)) {
+    for(int i = 0; i < STABLE_KEYS; i++) {
+      sprintf(key, "fisso %d", i);
+      assert(chash_get(ht, key, func_7, &i) == 0);
+    }
+
+    /* La scansione non blocca gli inserimenti, e vede ogni chiave mai
+       rimossa esattamente una volta */
+    memset(seen, 0, sizeof(seen));
+    assert(chash_get_all(ht, func_8, seen) == 0);
+    for(int i = 0; i < STABLE_KEYS; i++) {
+      assert(seen[i] == 1);
+    }
+  }
+  return NULL;
+}
+
 int main(void) {
-  chash_t *ht = chash_init();
+  chash_t *ht = chash_init(8);
   pthread_t threads[8];
   struct arg args[8];
   const char *keys[8] = {
@@ -51,7 +142,93 @@ int main(void) {
     pthread_join(threads[i], NULL);
   }
 
-  chash_get_all(ht, func_2, keys);
+  chash_get_all(ht, func_3, keys);
+  chash_get_all(ht, func_2, ht);
+  char **noKeys;
+  assert(chash_keys(ht, &noKeys) == 0);
+  free(noKeys);
+  chash_deinit(ht, NULL);
+
+  /* Crescita della tabella, a partire dalla capienza minima */
+  ht = chash_init(0);
+  assert(ht != NULL);
+  char key[32];
+  for(int i = 0; i < STABLE_KEYS; i++) {
+    sprintf(key, "fisso %d", i);
+    assert(chash_set_if_empty(ht, key, (void*)(intptr_t)(i + 1)) == 0);
+  }
+
+  /* Le letture avvengono senza lock, in parallelo con gli inserimenti */
+  pthread_t reader;
+  pthread_create(&reader, NULL, func_9, ht);
+
+  struct grow_arg gargs[THREADS];
+  for(int i = 0; i < THREADS; i++) {
+    gargs[i].ht = ht;
+    gargs[i].id = i;
+    pthread_create(threads + i, NULL, func_4, gargs + i);
+  }
+  for(int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  __atomic_store_n(&growing, 0, __ATOMIC_RELEASE);
+  pthread_join(reader, NULL);
 
+  for(int t = 0; t < THREADS; t++) {
+    for(int i = 0; i < KEYS_PER_THREAD; i++) {
+      sprintf(key, "utente %d-%d", t, i);
+      assert(chash_get(ht, key, func_5, &i) == 0);
+    }
+  }
+
+  char **allKeys;
+  int n = chash_keys(ht, &allKeys);
+  assert(n == THREADS * KEYS_PER_THREAD / 2 + STABLE_KEYS);
+  for(int i = 0; i < n; i++) {
+    free(allKeys[i]);
+  }
+  free(allKeys);
+
+  /* Le chiavi eliminate possono essere reinserite */
+  for(int i = 0; i < KEYS_PER_THREAD; i += 2) {
+    sprintf(key, "utente 0-%d", i);
+    assert(chash_set_if_empty(ht, key, (void*)(intptr_t)(i + 1)) == 0);
+  }
+  n = chash_keys(ht, &allKeys);
+  assert(n == THREADS * KEYS_PER_THREAD / 2 + KEYS_PER_THREAD / 2 + STABLE_KEYS);
+  for(int i = 0; i < n; i++) {
+    free(allKeys[i]);
+  }
+  free(allKeys);
+
+  assert(chash_deinit(ht, NULL) == 0);
+
+  /* Chiavi di ogni lunghezza, che differiscono solo nel primo o
+     nell'ultimo byte o sono prefissi l'una dell'altra */
+  ht = chash_init(0);
+  char lkey[MAX_KEY_LEN + 1];
+  for(int len = 0; len <= MAX_KEY_LEN; len++) {
+    for(int c = 0; c < 3; c++) {
+      memset(lkey, 'a', len);
+      lkey[len] = '\0';
+      if(len > 0 && c == 1) lkey[len - 1] = 'b';
+      if(len > 0 && c == 2) lkey[0] = 'b';
+      if(len <= 1 && c == 2) continue;
+      intptr_t v = len * 3 + c + 1;
+      assert(chash_set_if_empty(ht, lkey, (void*)v) == (len == 0 && c > 0 ? 1 : 0));
+    }
+  }
+  for(int len = 0; len <= MAX_KEY_LEN; len++) {
+    for(int c = 0; c < 3; c++) {
+      memset(lkey, 'a', len);
+      lkey[len] = '\0';
+      if(len > 0 && c == 1) lkey[len - 1] = 'b';
+      if(len > 0 && c == 2) lkey[0] = 'b';
+      if(len <= 1 && c == 2) continue;
+      intptr_t v = len == 0 ? 1 : len * 3 + c + 1;
+      assert(chash_get(ht, lkey, func_6, &v) == 0);
+    }
+  }
+  assert(chash_deinit(ht, NULL) == 0);
   return 0;
 }
\ No newline at end of file
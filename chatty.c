@@ -16,22 +16,32 @@
 #include <string.h>
 #include <signal.h>
 #include <pthread.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <fcntl.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
 
 #include "stats.h"
 #include "cfgparse.h"
 #include "errman.h"
+#include "csched.h"
 #include "cqueue.h"
 #include "chash.h"
+#include "cebr.h"
+#include "cslab.h"
+#include "carena.h"
 #include "ccircbuf.h"
 #include "connections.h"
+#include "msgbuf.h"
+#include "outqueue.h"
 
 #include "chatty_handlers.h"
 
@@ -40,40 +50,93 @@
                     (signalStatus == SIGQUIT) || \
                     (signalStatus == SIGTERM))
 
+/// Numero massimo di eventi estratti da una singola epoll_wait
+#define MAX_EVENTS 64
+
+/// Numero massimo di richieste di un client servite consecutivamente
+#define REQUEST_BUDGET 32
+
+/// Dimensione del primo blocco dell'arena per le richieste di ogni thread
+#define REQUEST_ARENA_SIZE (64 * 1024)
+
+/// Capienza del buffer di ingresso di ogni connessione
+#define CONN_BUFFER_SIZE 4096
+
+/// Numero massimo predefinito di messaggi in coda per ogni client
+#define DEFAULT_MAX_OUT_QUEUE 1024
+
+/// Numero di utenti registrati previsti inizialmente, la tabella cresce se necessario
+#define INITIAL_USERS 1024
+
+/// Numero di gruppi previsti inizialmente, la tabella cresce se necessario
+#define INITIAL_GROUPS 256
+
+/// Valore inserito nello scheduler per segnalare un'operazione in \ref payload_t.tasks
+#define TASK_PENDING -2
+
+/// Numero di descrittori apribili assunto se il limite di sistema è infinito
+#define MAX_OPEN_FDS 65536
+
 /// Controlla la validità di un valore di configurazione
 #define CHECK_VAL(x) if(!(x)) { \
                        errno = EINVAL; \
                        return 0; \
                      }
 
-/// Contiene l'ultimo segnale ricevuto
+/// Contiene l'ultimo segnale di terminazione ricevuto, letto dal signalfd
 volatile sig_atomic_t signalStatus = 0;
 
+/// Arena per le allocazioni temporanee delle richieste servite dal thread
+static __thread carena_t *thread_arena = NULL;
+
+/// Event loop gestito dal thread, NULL se il thread non ne gestisce uno
+static __thread event_loop_t *own_loop = NULL;
+
+carena_t *request_arena(void) {
+  return thread_arena;
+}
+
+/**
+ * \brief Crea l'arena per le richieste del thread corrente
+ */
+static void arena_attach(void) {
+  thread_arena = carena_init(REQUEST_ARENA_SIZE);
+  HANDLE_NULL(thread_arena, "carena_init");
+}
+
+/**
+ * \brief Distrugge l'arena per le richieste del thread corrente
+ */
+static void arena_detach(void) {
+  carena_deinit(thread_arena);
+  thread_arena = NULL;
+}
+
 void free_client_descriptor(void *ptr) {
   if(ptr == NULL) return;
 
   client_descriptor_t *cd = (client_descriptor_t*)ptr;
   void** messages;
-  int numMsg = ccircbuf_get_elems(cd->message_buffer, &messages);
+  int numMsg = ccircbuf_get_elems(cd->message_buffer, &messages, NULL);
   HANDLE_FATAL(numMsg, "ccircbuf_get_elems");
 
   for(int i = 0; i < numMsg; i++) {
-    message_t *msg = messages[i];
-    free(msg->data.buf);
-    free(messages[i]);
+    cmessage_unref(messages[i]);
   }
   free(messages);
   HANDLE_FATAL(ccircbuf_deinit(cd->message_buffer), "ccircbuf_deinit");
 
+  free(cd->groups);
+  HANDLE_FATAL(pthread_mutex_destroy(&(cd->groups_mtx)), "pthread_mutex_destroy");
   free(cd);
 }
 
 void free_group(void *ptr) {
   if(ptr == NULL) return;
 
-  cstrlist_t *list = (cstrlist_t*)ptr;
-  int ret = cstrlist_deinit(list);
-  HANDLE_FATAL(ret, "cstrlist_deinit");
+  cidset_t *group = (cidset_t*)ptr;
+  int ret = cidset_deinit(group);
+  HANDLE_FATAL(ret, "cidset_deinit");
 }
 
 /**
@@ -104,6 +167,9 @@ static int load_cfg(const char *name, const char *value, void *ud) {
   } else if(strcmp(name, "ThreadsInPool") == 0) {
     cfg->threadsInPool = atoi(value);
     CHECK_VAL(cfg->threadsInPool);
+  } else if(strcmp(name, "FileThreadsInPool") == 0) {
+    cfg->fileThreadsInPool = atoi(value);
+    CHECK_VAL(cfg->fileThreadsInPool >= 0);
   } else if(strcmp(name, "MaxMsgSize") == 0) {
     cfg->maxMsgSize = atoi(value);
     CHECK_VAL(cfg->maxMsgSize);
@@ -117,6 +183,29 @@ static int load_cfg(const char *name, const char *value, void *ud) {
     memcpy(cfg->dirName, value, sizeof(char) * valueLen + 1);
   } else if(strcmp(name, "StatFileName") == 0) {
     memcpy(cfg->statFileName, value, sizeof(char) * valueLen + 1);
+  } else if(strcmp(name, "DispatchMode") == 0) {
+    if(strcmp(value, "queue") == 0) {
+      cfg->dispatchMode = DISPATCH_QUEUE;
+    } else if(strcmp(value, "roundrobin") == 0) {
+      cfg->dispatchMode = DISPATCH_ROUND_ROBIN;
+    } else if(strcmp(value, "leastloaded") == 0) {
+      cfg->dispatchMode = DISPATCH_LEAST_LOADED;
+    } else {
+      errno = EINVAL;
+      return 0;
+    }
+  } else if(strcmp(name, "MaxOutQueue") == 0) {
+    cfg->maxOutQueue = atoi(value);
+    CHECK_VAL(cfg->maxOutQueue >= 0);
+  } else if(strcmp(name, "OutQueuePolicy") == 0) {
+    if(strcmp(value, "disconnect") == 0) {
+      cfg->outQueuePolicy = OUTQUEUE_DISCONNECT;
+    } else if(strcmp(value, "drop") == 0) {
+      cfg->outQueuePolicy = OUTQUEUE_DROP;
+    } else {
+      errno = EINVAL;
+      return 0;
+    }
   } else {
     /* Opzione non riconosciuta */
     errno = EINVAL;
@@ -167,98 +256,514 @@ static int read_cfg_file(const char *file, struct server_cfg *cfg) {
 }
 
 /**
- * \brief Gestore dei segnali minimale
+ * \brief Imposta la gestione dei segnali
  * 
- * Lascia tutto il lavoro di gestione al resto del programma
+ * I segnali da gestire vengono bloccati e consegnati tramite un signalfd,
+ * che viene ascoltato dal thread principale insieme agli altri descrittori.
+ * La maschera viene ereditata dai thread creati in seguito, per cui deve
+ * essere impostata prima di avviare il pool.
  * 
- * \param signal Il segnale da gestire
+ * \return int Il signalfd da cui leggere i segnali ricevuti
  */
-static void signal_handler(int signal) {
-  signalStatus = signal;
-}
+static int setup_signal_handlers() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGQUIT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  HANDLE_FATAL(sigprocmask(SIG_BLOCK, &mask, NULL), "sigprocmask");
+
+  int sfd = signalfd(-1, &mask, 0);
+  HANDLE_FATAL(sfd, "signalfd");
 
-/**
- * \brief Imposta gli handler per i segnali da gestire
- */
-static void setup_signal_handlers() {
   struct sigaction s;
   memset(&s, 0, sizeof(s));
-  s.sa_handler = signal_handler;
-  HANDLE_FATAL(sigaction(SIGINT, &s, NULL), "sigaction");
-  HANDLE_FATAL(sigaction(SIGQUIT, &s, NULL), "sigaction");
-  HANDLE_FATAL(sigaction(SIGTERM, &s, NULL), "sigaction");
-  HANDLE_FATAL(sigaction(SIGUSR1, &s, NULL), "sigaction");
-
   s.sa_handler = SIG_IGN; /* Ignora SIGPIPE */
   HANDLE_FATAL(sigaction(SIGPIPE, &s, NULL), "sigaction");
+
+  return sfd;
+}
+
+/**
+ * \brief Riattiva l'ascolto di un client su un'istanza epoll
+ * 
+ * I client sono registrati con EPOLLONESHOT: dopo che un evento è stato
+ * notificato il descrittore resta disabilitato finchè il thread che lo sta
+ * servendo non lo riattiva, in modo che un solo thread alla volta lo gestisca.
+ * 
+ * \param epfd L'istanza epoll su cui è registrato il client
+ * \param fd Il descrittore da riattivare
+ */
+static void rearm_socket(int epfd, long fd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = fd;
+
+  int res = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+  if(res < 0 && (errno == EBADF || errno == ENOENT)) {
+    /* Il descrittore è stato chiuso durante la gestione della richiesta */
+    return;
+  }
+  HANDLE_FATAL(res, "epoll_ctl");
+}
+
+/**
+ * \brief Rimette in coda un client che ha già ricevuto richieste complete
+ * 
+ * Il descrittore resta disattivato sull'istanza epoll, per cui il client
+ * continua ad essere servito da un solo thread alla volta. Le richieste
+ * vengono servite senza attendere eventi sul socket, anche se il client non
+ * legge le risposte e la sua coda di uscita è piena.
+ * 
+ * \param pl Dati di contesto
+ * \param loop L'event loop a cui è assegnato il client, NULL se i client
+ *             vengono distribuiti tramite lo scheduler
+ * \param fd Il descrittore del client
+ */
+static void requeue_client(payload_t *pl, event_loop_t *loop, long fd) {
+  if(loop == NULL) {
+    HANDLE_FATAL(csched_push(pl->ready_sockets, fd % pl->cfg->threadsInPool, fd), "csched_push");
+    return;
+  }
+
+  HANDLE_FATAL(cring_push(loop->ready, fd), "cring_push");
+  if(loop != own_loop) {
+    /* Il thread dell'event loop potrebbe essere in attesa su epoll_wait */
+    uint64_t one = 1;
+    HANDLE_FATAL(write(loop->ready_fd, &one, sizeof(one)), "write");
+  }
+}
+
+/**
+ * \brief Richiesta di un'operazione sui file affidata al pool dedicato
+ */
+typedef struct {
+  long fd; ///< Il descrittore del client
+  event_loop_t *loop; ///< L'event loop a cui è assegnato il client, NULL se non presente
+  message_t msg; ///< La richiesta da servire
+} file_job_t;
+
+/**
+ * \brief Conclude la gestione di una richiesta
+ * 
+ * Se il client è ancora connesso e ha altre richieste complete nel buffer
+ * di ingresso lo rimette in coda, se non ne ha lo riattiva sull'istanza
+ * epoll; altrimenti chiude il descrittore.
+ * 
+ * \param pl Dati di contesto
+ * \param loop L'event loop a cui è assegnato il client (opzionale)
+ * \param fd Il descrittore del client
+ * \param is_connected 0 se il client si è disconnesso
+ */
+static void finish_request(payload_t *pl, event_loop_t *loop, long fd, int is_connected) {
+  if(is_connected) {
+    /* Se il client non si è disconnesso durante l'operazione, va ancora
+       servito */
+    if(msgbuf_has_msg(&(pl->conns[fd].in))) {
+      requeue_client(pl, loop, fd);
+    } else {
+      rearm_socket(loop == NULL ? pl->epoll_fd : loop->epoll_fd, fd);
+    }
+  } else {
+    /* Il client, il buffer e la coda vanno liberati prima della chiusura,
+       dopo la quale il descrittore può essere riassegnato ad un nuovo
+       client. Se il client era già stato disconnesso non ha effetto */
+    disconnect_client(fd, pl, NULL);
+    outqueue_close(&(pl->conns[fd].out), fd, pl->out_epoll_fd);
+    msgbuf_free(&(pl->conns[fd].in));
+    close(fd);
+    if(loop != NULL) __atomic_sub_fetch(&(loop->nclients), 1, __ATOMIC_RELAXED);
+  }
 }
 
 /**
- * \brief Funzione eseguita dai thread nel pool
+ * \brief Funzione eseguita dai thread del pool dedicato alle operazioni
+ *        sui file
  * 
  * \param data Puntatore alla struttura che fornisce il contesto su cui lavorare
  * \return void* Sempre NULL
  */
-void *worker_thread(void *data) {
+void *file_worker_thread(void *data) {
   payload_t *pl = (payload_t*)data;
+  arena_attach();
+  for(;;) {
+    file_job_t *job;
+    HANDLE_FATAL(cqueue_pop(pl->file_jobs, (void**)&job), "cqueue_pop");
+
+    if(job == NULL) {
+      /* Segnale di uscita, viene reimmesso per gli altri thread */
+      HANDLE_FATAL(cqueue_push(pl->file_jobs, NULL), "cqueue_push");
+      arena_detach();
+      return NULL;
+    }
+
+    int is_connected = 1;
+    chatty_handlers[job->msg.hdr.op](job->fd, &(job->msg), pl, &is_connected);
+    carena_reset(thread_arena);
+    cslab_free(job->msg.data.buf);
+    finish_request(pl, job->loop, job->fd, is_connected);
+    cslab_free(job);
+  }
+}
+
+/**
+ * \brief Legge e serve una singola richiesta di un client
+ * 
+ * Le operazioni sui file vengono affidate al pool dedicato, se presente, che
+ * si occuperà di riattivare o chiudere il descrittore al loro termine.
+ * 
+ * \param pl Dati di contesto
+ * \param loop L'event loop a cui è assegnato il client (opzionale)
+ * \param fd Il descrittore del client
+ * \param is_connected Viene impostato a 0 se il client si è disconnesso
+ * \return int 1 se la richiesta è stata affidata al pool dedicato ai file, 0 altrimenti
+ */
+static int serve_request(payload_t *pl, event_loop_t *loop, long fd, int *is_connected) {
+  message_t msg;
+  memset(&msg, 0, sizeof(message_t));
+
+  int res = msgbuf_read_msg(fd, &(pl->conns[fd].in), &msg);
+  if(res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    /* La richiesta non è ancora arrivata per intero: quanto ricevuto resta
+       nel buffer, e la lettura riprende quando il client invia il resto */
+    return 0;
+  }
+  if(HAS_DISCONNECTED(res)) {
+    LOG_ERR("%s", strerror(errno));
+    res = 0;
+  } else HANDLE_FATAL(res, "msgbuf_read_msg");
+
+  if(res == 0) {
+    /* Il client si è disconnesso */
+    disconnect_client(fd, pl, NULL);
+    *is_connected = 0;
+  } else if(msg.hdr.op >= OP_CLIENT_END) {
+    LOG_WARN("Ricevuto messaggio non valido dal client %ld", fd);
+    send_error_message(fd, OP_FAIL, pl, NULL, "Messaggio non valido");
+  } else if(msg.hdr.sender[0] != '\0') {
+    if(pl->file_jobs != NULL &&
+       (msg.hdr.op == POSTFILE_OP || msg.hdr.op == GETFILE_OP)) {
+      /* Il descrittore resta disattivato finchè il pool dedicato
+         non ha terminato l'operazione */
+      file_job_t *job = cslab_calloc(1, sizeof(file_job_t));
+      HANDLE_NULL(job, "cslab_calloc");
+      job->fd = fd;
+      job->loop = loop;
+      job->msg = msg;
+      HANDLE_FATAL(cqueue_push(pl->file_jobs, job), "cqueue_push");
+      return 1;
+    }
+
+    /* Esegue il gestore di richieste in base all'operazione */
+    chatty_handlers[msg.hdr.op](fd, &msg, pl, is_connected);
+  } else {
+    /* Messaggio spurio, ignorato */
+    LOG_INFO("Messaggio spurio da %ld ignorato", fd);
+  }
+
+  /* I buffer temporanei della richiesta non servono più */
+  carena_reset(thread_arena);
+  cslab_free(msg.data.buf);
+  return 0;
+}
+
+/**
+ * \brief Serve le richieste di un client pronto
+ * 
+ * Dopo la prima richiesta, continua a servire quelle già presenti per intero
+ * nel buffer di ingresso, fino ad un massimo di \ref REQUEST_BUDGET richieste
+ * per non far attendere troppo gli altri client. Al termine la gestione
+ * viene conclusa con \ref finish_request.
+ * 
+ * \param pl Dati di contesto
+ * \param loop L'event loop a cui è assegnato il client (opzionale)
+ * \param fd Il descrittore del client
+ */
+static void serve_client(payload_t *pl, event_loop_t *loop, long fd) {
+  int is_connected = 1;
+
+  for(int served = 0; served < REQUEST_BUDGET; served++) {
+    if(serve_request(pl, loop, fd, &is_connected)) {
+      /* Il descrittore è ora gestito dal pool dedicato ai file */
+      return;
+    }
+
+    if(!is_connected || !msgbuf_has_msg(&(pl->conns[fd].in))) break;
+  }
+
+  /* Se il budget è esaurito ma restano richieste da servire, il client
+     viene rimesso in coda dopo quelli già in attesa */
+  finish_request(pl, loop, fd, is_connected);
+}
+
+/**
+ * \brief Estrae ed esegue un'operazione affidata ai thread del pool
+ * 
+ * Va chiamata solo quando è certo che un'operazione sia in attesa.
+ * 
+ * \param pl Dati di contesto
+ */
+static void run_task(payload_t *pl) {
+  chatty_task_t *task;
+  HANDLE_FATAL(cqueue_pop(pl->tasks, (void**)&task), "cqueue_pop");
+
+  task->fn(task->arg, pl);
+  cslab_free(task);
+}
+
+void dispatch_task(payload_t *pl, chatty_task_fn *fn, void *arg) {
+  if(cqueue_size(pl->tasks) >= pl->max_fds) {
+    /* Troppe operazioni in attesa: viene eseguita dal thread chiamante,
+       rallentando chi le produce */
+    fn(arg, pl);
+    return;
+  }
+
+  chatty_task_t *task = cslab_alloc(sizeof(chatty_task_t));
+  HANDLE_NULL(task, "cslab_alloc");
+  task->fn = fn;
+  task->arg = arg;
+  HANDLE_FATAL(cqueue_push(pl->tasks, task), "cqueue_push");
+
+  /* L'operazione viene notificata dopo essere stata accodata, per cui chi
+     riceve la notifica la troverà sempre in coda */
+  if(pl->cfg->dispatchMode == DISPATCH_QUEUE) {
+    /* Le operazioni vengono distribuite a turno fra i thread */
+    unsigned int worker = __atomic_fetch_add(&(pl->next_task), 1, __ATOMIC_RELAXED);
+    if(csched_push(pl->ready_sockets, worker % pl->cfg->threadsInPool, TASK_PENDING) < 0) {
+      HANDLE_FATAL(errno == EAGAIN ? 0 : -1, "csched_push");
+      /* Lo scheduler è pieno: l'operazione viene eseguita subito */
+      run_task(pl);
+    }
+  } else {
+    uint64_t one = 1;
+    HANDLE_FATAL(write(pl->task_fd, &one, sizeof(one)), "write");
+  }
+}
+
+/**
+ * \brief Contesto di un thread del pool quando i client vengono
+ *        distribuiti tramite lo scheduler
+ */
+typedef struct {
+  payload_t *pl; ///< Dati di contesto
+  int id; ///< Indice del thread, usato come coda nello scheduler
+} worker_t;
+
+/**
+ * \brief Funzione eseguita dai thread nel pool quando i client
+ *        vengono distribuiti tramite lo scheduler
+ * 
+ * Ogni thread serve prima i client assegnati alla propria coda, e ruba
+ * dalle code degli altri thread solo quando la propria è vuota. Le code
+ * contengono anche le notifiche delle operazioni affidate al pool.
+ * 
+ * \param data Puntatore al contesto del thread (\ref worker_t*)
+ * \return void* Sempre NULL
+ */
+void *worker_thread(void *data) {
+  worker_t *w = (worker_t*)data;
+  payload_t *pl = w->pl;
+  arena_attach();
   while(!SHOULD_EXIT) {
-    long *elem;
-    HANDLE_FATAL(cqueue_pop(pl->ready_sockets, (void*)&elem), "cqueue_pop");
+    long fd;
+    HANDLE_FATAL(csched_pop(pl->ready_sockets, w->id, &fd), "csched_pop");
 
-    long fd = *elem;
     if(fd == -1) {
       /*
        * Segnale speciale di uscita, viene reimmesso in coda
        * prima di uscire in modo da renderlo disponibile al
        * prossimo thread in attesa
        */
-      cqueue_push(pl->ready_sockets, elem);
-      return NULL;
+      HANDLE_FATAL(csched_push(pl->ready_sockets, w->id, fd), "csched_push");
+      break;
     }
-    free(elem);
-
-    message_t msg;
-    memset(&msg, 0, sizeof(message_t));
 
-    int res = readMsg(fd, &msg);
-    if(HAS_DISCONNECTED(res)) {
-      LOG_ERR("%s", strerror(errno));
-      disconnect_client(fd, pl, NULL);
+    if(fd == TASK_PENDING) {
+      run_task(pl);
       continue;
-    } else HANDLE_FATAL(res, "readMsg");
+    }
 
-    if(res == 0) {
-      /* Il client si è disconnesso */
-      disconnect_client(fd, pl, NULL);
-    } else {
-      if(msg.hdr.op >= OP_CLIENT_END) {
-        LOG_WARN("Ricevuto messaggio non valido dal client %ld", fd);
-        MUTEX_GUARD(pl->connected_clients_mtx, {
-          send_error_message(fd, OP_FAIL, pl, NULL, "Messaggio non valido", NULL);
-        });
-      } else {
-        if(msg.hdr.sender[0] != '\0') {
-          /* Esegue il gestore di richieste in base all'operazione */
-          int is_connected = 1;
-          chatty_handlers[msg.hdr.op](fd, &msg, pl, &is_connected);
-
-          MUTEX_GUARD(pl->set_mtx, {
-            /* Se il client non si è disconnesso durante l'operazione, va ancora
-               ascoltato */
-            if(is_connected) FD_SET(fd, &(pl->set));
-          });
+    serve_client(pl, NULL, fd);
+  }
+
+  arena_detach();
+  return NULL;
+}
+
+/**
+ * \brief Funzione eseguita dai thread nel pool quando ognuno di essi
+ *        gestisce un proprio event loop
+ * 
+ * Il thread ascolta solamente i client che gli sono stati assegnati dal
+ * thread principale e li serve direttamente, senza passare da code condivise.
+ * I client rimessi in coda perchè hanno altre richieste da servire vengono
+ * serviti dopo gli eventi notificati da ogni attesa.
+ * 
+ * \param data Puntatore all'event loop gestito dal thread (\ref event_loop_t*)
+ * \return void* Sempre NULL
+ */
+void *loop_worker_thread(void *data) {
+  event_loop_t *loop = (event_loop_t*)data;
+  payload_t *pl = loop->pl;
+  struct epoll_event events[MAX_EVENTS];
+  arena_attach();
+  own_loop = loop;
+
+  while(!SHOULD_EXIT) {
+    /* Se ci sono client in coda non si attende, ma si controlla solo
+       se altri client sono pronti */
+    int pending = cring_size(loop->ready);
+    HANDLE_FATAL(pending, "cring_size");
+
+    int res = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, pending > 0 ? 0 : -1);
+    if(res < 0) {
+      if(errno == EINTR) continue;
+      HANDLE_FATAL(res, "epoll_wait");
+    }
+
+    for(int i = 0; i < res; i++) {
+      long fd = events[i].data.fd;
+      if(fd == pl->wakeup_fd) {
+        /* Il server sta terminando. L'eventfd non viene svuotato, in modo
+           che anche gli altri thread vengano risvegliati */
+        arena_detach();
+        return NULL;
+      }
+
+      if(fd == pl->task_fd) {
+        /* Il contatore viene decrementato di uno: se un altro thread
+           ha già preso l'operazione, la lettura fallisce */
+        uint64_t val;
+        if(read(pl->task_fd, &val, sizeof(val)) < 0) {
+          HANDLE_FATAL(errno == EAGAIN ? 0 : -1, "read");
         } else {
-          /* Messaggio spurio, ignorato */
-          LOG_INFO("Messaggio spurio da %ld ignorato", fd);
+          run_task(pl);
+        }
+        continue;
+      }
+
+      if(fd == loop->ready_fd) {
+        /* La notifica serve solo a interrompere l'attesa, i client
+           vengono estratti dalla coda qui sotto */
+        uint64_t val;
+        if(read(loop->ready_fd, &val, sizeof(val)) < 0) {
+          HANDLE_FATAL(errno == EAGAIN ? 0 : -1, "read");
         }
+        continue;
+      }
+
+      serve_client(pl, loop, fd);
+    }
+
+    /* Vengono serviti solo i client già in coda: quelli che vi vengono
+       rimessi ora attendono il prossimo giro, dopo gli altri client */
+    pending = cring_size(loop->ready);
+    HANDLE_FATAL(pending, "cring_size");
+    for(int i = 0; i < pending; i++) {
+      long fd;
+      if(cring_try_pop(loop->ready, &fd) < 0) {
+        /* Un inserimento contato ma non ancora completato */
+        HANDLE_FATAL(errno == EAGAIN ? 0 : -1, "cring_try_pop");
+        break;
       }
+      serve_client(pl, loop, fd);
     }
-    free(msg.data.buf);
   }
 
+  arena_detach();
   return NULL;
 }
 
+/**
+ * \brief Funzione eseguita dal thread che svuota le code di uscita
+ * 
+ * Attende che i client con messaggi in coda tornino scrivibili, e scrive
+ * quanto possibile dei messaggi in attesa. Non chiude mai i descrittori:
+ * se un client non è più raggiungibile la coda effettua una shutdown del
+ * socket, e la disconnessione viene gestita dal thread che lo legge.
+ * 
+ * \param data Puntatore alla struttura che fornisce il contesto su cui lavorare
+ * \return void* Sempre NULL
+ */
+void *flusher_thread(void *data) {
+  payload_t *pl = (payload_t*)data;
+  struct epoll_event events[MAX_EVENTS];
+
+  for(;;) {
+    int res = epoll_wait(pl->out_epoll_fd, events, MAX_EVENTS, -1);
+    if(res < 0) {
+      if(errno == EINTR) continue;
+      HANDLE_FATAL(res, "epoll_wait");
+    }
+
+    for(int i = 0; i < res; i++) {
+      long fd = events[i].data.fd;
+      if(fd == pl->wakeup_fd) return NULL;
+
+      outqueue_flush(&(pl->conns[fd].out), fd, pl->out_epoll_fd);
+    }
+  }
+}
+
+/**
+ * \brief Sceglie l'event loop a cui assegnare un nuovo client
+ * 
+ * \param pl Dati di contesto
+ * \return event_loop_t* L'event loop scelto secondo \ref server_cfg.dispatchMode
+ */
+static event_loop_t *choose_loop(payload_t *pl) {
+  if(pl->cfg->dispatchMode == DISPATCH_ROUND_ROBIN) {
+    event_loop_t *loop = &(pl->loops[pl->next_loop]);
+    pl->next_loop = (pl->next_loop + 1) % pl->cfg->threadsInPool;
+    return loop;
+  }
+
+  event_loop_t *best = &(pl->loops[0]);
+  long bestLoad = __atomic_load_n(&(best->nclients), __ATOMIC_RELAXED);
+  for(int i = 1; i < pl->cfg->threadsInPool; i++) {
+    long load = __atomic_load_n(&(pl->loops[i].nclients), __ATOMIC_RELAXED);
+    if(load < bestLoad) {
+      best = &(pl->loops[i]);
+      bestLoad = load;
+    }
+  }
+  return best;
+}
+
+/**
+ * \brief Inizia ad ascoltare un client appena accettato
+ * 
+ * \param pl Dati di contesto
+ * \param fd Il descrittore del nuovo client
+ */
+static void add_client(payload_t *pl, int fd) {
+  assert(fd < pl->max_fds);
+  HANDLE_FATAL(msgbuf_init(&(pl->conns[fd].in), CONN_BUFFER_SIZE), "msgbuf_init");
+
+  /* Le scritture non devono mai bloccarsi su un client lento: quanto non
+     può essere scritto subito viene accodato */
+  int flags = fcntl(fd, F_GETFL);
+  HANDLE_FATAL(flags, "fcntl");
+  HANDLE_FATAL(fcntl(fd, F_SETFL, flags | O_NONBLOCK), "fcntl");
+  HANDLE_FATAL(outqueue_open(&(pl->conns[fd].out), fd, pl->out_epoll_fd), "outqueue_open");
+
+  int epfd = pl->epoll_fd;
+  if(pl->cfg->dispatchMode != DISPATCH_QUEUE) {
+    event_loop_t *loop = choose_loop(pl);
+    __atomic_add_fetch(&(loop->nclients), 1, __ATOMIC_RELAXED);
+    epfd = loop->epoll_fd;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = fd;
+  HANDLE_FATAL(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev), "epoll_ctl");
+}
+
 /** Funzione d'entrata */
 int main(int argc, char *argv[]) {
   if(argc != 3 || strcmp(argv[1], "-f") != 0) {
@@ -268,6 +773,7 @@ int main(int argc, char *argv[]) {
 
   struct server_cfg cfg;
   memset(&cfg, 0, sizeof(cfg));
+  cfg.maxOutQueue = DEFAULT_MAX_OUT_QUEUE;
 
   printf("Caricamento file di configurazione... ");
 
@@ -282,42 +788,56 @@ int main(int argc, char *argv[]) {
 
   printf("fatto.\nInizializzazione del server... ");
 
-  setup_signal_handlers();
+  int signal_fd = setup_signal_handlers();
 
   /* Conterrà i dati condivisi dai vari thread */
   payload_t payload;
   memset(&payload, 0, sizeof(payload_t));
-  payload.registered_clients = chash_init();
-  HANDLE_NULL(payload.registered_clients, "chash_init");
+  payload.users = cintern_init(INITIAL_USERS);
+  HANDLE_NULL(payload.users, "cintern_init");
 
-  payload.groups = chash_init();
+  payload.groups = chash_init(INITIAL_GROUPS);
   HANDLE_NULL(payload.groups, "chash_init");
 
-  payload.ready_sockets = cqueue_init();
-  HANDLE_NULL(payload.ready_sockets, "cqueue_init");
+  /* Grazie a EPOLLONESHOT ogni descrittore è in coda al più una volta,
+     per cui basta poter contenere tutti i descrittori apribili. Le code
+     dei thread sono riempite in modo uniforme, e se una è piena lo
+     scheduler usa le altre */
+  struct rlimit nofile;
+  HANDLE_FATAL(getrlimit(RLIMIT_NOFILE, &nofile), "getrlimit");
+  if(nofile.rlim_cur == RLIM_INFINITY) nofile.rlim_cur = MAX_OPEN_FDS;
+  /* Le code contengono anche le notifiche delle operazioni in attesa, che
+     sono al più tante quanti i descrittori apribili */
+  payload.ready_sockets = csched_init(cfg.threadsInPool,
+                                      2 * (nofile.rlim_cur / cfg.threadsInPool + 2));
+  HANDLE_NULL(payload.ready_sockets, "csched_init");
+
+  payload.max_fds = nofile.rlim_cur;
+  payload.conns = calloc(payload.max_fds, sizeof(connection_t));
+  HANDLE_NULL(payload.conns, "calloc");
+  for(long i = 0; i < payload.max_fds; i++) {
+    HANDLE_FATAL(outqueue_init(&(payload.conns[i].out)), "outqueue_init");
+    payload.conns[i].online_idx = -1;
+  }
 
   HANDLE_FATAL(pthread_mutex_init(&(payload.connected_clients_mtx), NULL), "pthread_mutex_init");
   HANDLE_FATAL(pthread_mutex_init(&(payload.stats_mtx), NULL), "pthread_mutex_init");
-  HANDLE_FATAL(pthread_mutex_init(&(payload.set_mtx), NULL), "pthread_mutex_init");
 
-  payload.connected_clients = calloc(cfg.maxConnections, sizeof(connected_client_t));
-  HANDLE_NULL(payload.connected_clients, "calloc");
+  payload.online = calloc(cfg.maxConnections, sizeof(long));
+  HANDLE_NULL(payload.online, "calloc");
 
   payload.cfg = &cfg;
 
-  for(int i = 0; i < cfg.maxConnections; i++) {
-    payload.connected_clients[i].fd = -1;
-  }
-
   pthread_t *threadPool = calloc(cfg.threadsInPool, sizeof(pthread_t));
   HANDLE_NULL(threadPool, "calloc");
 
   int fd_sk;
   struct sockaddr_un sa;
-  fd_set readSet;
+  struct epoll_event events[MAX_EVENTS];
 
   /* Creazione del socket */
-  strncpy(sa.sun_path, cfg.socketPath, MAX_PATH_LEN);
+  memset(&sa, 0, sizeof(sa));
+  strncpy(sa.sun_path, cfg.socketPath, sizeof(sa.sun_path) - 1);
   sa.sun_family = AF_UNIX;
   fd_sk = socket(AF_UNIX, SOCK_STREAM, 0);
   HANDLE_FATAL(fd_sk, "socket");
@@ -326,94 +846,192 @@ int main(int argc, char *argv[]) {
   res = listen(fd_sk, SOMAXCONN);
   HANDLE_FATAL(res, "listen");
   
-  FD_ZERO(&(payload.set));
-  FD_SET(fd_sk, &(payload.set));
-
-  for(int i = 0; i < cfg.threadsInPool; i++) {
-    pthread_create(threadPool + i, NULL, worker_thread, &payload);
+  payload.epoll_fd = epoll_create1(0);
+  HANDLE_FATAL(payload.epoll_fd, "epoll_create1");
+
+  /* Il socket di ascolto resta sempre attivo (level-triggered), ed è gestito
+     solamente da questo thread */
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd_sk;
+  HANDLE_FATAL(epoll_ctl(payload.epoll_fd, EPOLL_CTL_ADD, fd_sk, &ev), "epoll_ctl");
+
+  /* Anche i segnali arrivano come eventi, per cui il thread principale può
+     attendere indefinitamente senza dover controllare periodicamente
+     signalStatus */
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = signal_fd;
+  HANDLE_FATAL(epoll_ctl(payload.epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev), "epoll_ctl");
+
+  /* Usato per risvegliare gli event loop dei thread alla terminazione */
+  payload.wakeup_fd = eventfd(0, 0);
+  HANDLE_FATAL(payload.wakeup_fd, "eventfd");
+
+  /* I messaggi che non possono essere scritti subito vengono inviati da un
+     thread dedicato quando il destinatario torna scrivibile */
+  payload.out_epoll_fd = epoll_create1(0);
+  HANDLE_FATAL(payload.out_epoll_fd, "epoll_create1");
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = payload.wakeup_fd;
+  HANDLE_FATAL(epoll_ctl(payload.out_epoll_fd, EPOLL_CTL_ADD, payload.wakeup_fd, &ev), "epoll_ctl");
+
+  pthread_t flusher;
+  pthread_create(&flusher, NULL, flusher_thread, &payload);
+
+  /* Operazioni affidate ai thread del pool, come la consegna dei messaggi
+     diretti a molti utenti. Negli event loop vengono notificate tramite un
+     eventfd usato come semaforo, che risveglia un solo thread */
+  payload.tasks = cqueue_init();
+  HANDLE_NULL(payload.tasks, "cqueue_init");
+  payload.task_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK);
+  HANDLE_FATAL(payload.task_fd, "eventfd");
+
+  worker_t *workers = NULL;
+  if(cfg.dispatchMode == DISPATCH_QUEUE) {
+    workers = calloc(cfg.threadsInPool, sizeof(worker_t));
+    HANDLE_NULL(workers, "calloc");
+
+    for(int i = 0; i < cfg.threadsInPool; i++) {
+      workers[i].pl = &payload;
+      workers[i].id = i;
+      pthread_create(threadPool + i, NULL, worker_thread, &(workers[i]));
+    }
+  } else {
+    payload.loops = calloc(cfg.threadsInPool, sizeof(event_loop_t));
+    HANDLE_NULL(payload.loops, "calloc");
+
+    for(int i = 0; i < cfg.threadsInPool; i++) {
+      event_loop_t *loop = &(payload.loops[i]);
+      loop->pl = &payload;
+      loop->epoll_fd = epoll_create1(0);
+      HANDLE_FATAL(loop->epoll_fd, "epoll_create1");
+
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.fd = payload.wakeup_fd;
+      HANDLE_FATAL(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, payload.wakeup_fd, &ev), "epoll_ctl");
+
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+      ev.data.fd = payload.task_fd;
+      HANDLE_FATAL(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, payload.task_fd, &ev), "epoll_ctl");
+
+      /* Ogni client è in coda al più una volta */
+      loop->ready = cring_init(payload.max_fds);
+      HANDLE_NULL(loop->ready, "cring_init");
+      loop->ready_fd = eventfd(0, EFD_NONBLOCK);
+      HANDLE_FATAL(loop->ready_fd, "eventfd");
+
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.fd = loop->ready_fd;
+      HANDLE_FATAL(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->ready_fd, &ev), "epoll_ctl");
+
+      pthread_create(threadPool + i, NULL, loop_worker_thread, loop);
+    }
   }
 
-  printf(" pronto. Server in ascolto.\n");
-
-  while(!SHOULD_EXIT) {
-    if(signalStatus == SIGUSR1) {
-      /* È stato ricevuto il segnale di scrittura delle statistiche */
-      FILE *statFile = fopen(cfg.statFileName, "a");
-      HANDLE_NULL(statFile, "fopen");
+  /* Le operazioni sui file, lente e bloccanti, vengono servite da un pool
+     separato in modo da non occupare i thread che gestiscono le altre */
+  pthread_t *fileThreadPool = NULL;
+  if(cfg.fileThreadsInPool > 0) {
+    payload.file_jobs = cqueue_init();
+    HANDLE_NULL(payload.file_jobs, "cqueue_init");
 
-      MUTEX_GUARD(payload.stats_mtx, {
-        HANDLE_FATAL(printStats(statFile, &(payload.chatty_stats)), "printStats");
-      });
+    fileThreadPool = calloc(cfg.fileThreadsInPool, sizeof(pthread_t));
+    HANDLE_NULL(fileThreadPool, "calloc");
 
-      fclose(statFile);
-
-      signalStatus = 0;
+    for(int i = 0; i < cfg.fileThreadsInPool; i++) {
+      pthread_create(fileThreadPool + i, NULL, file_worker_thread, &payload);
     }
+  }
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 10000;
-
-    MUTEX_GUARD(payload.set_mtx, {
-      readSet = payload.set;
-    });
+  printf(" pronto. Server in ascolto.\n");
 
-    res = select(FD_SETSIZE, &readSet, NULL, NULL, &timeout);
+  while(!SHOULD_EXIT) {
+    res = epoll_wait(payload.epoll_fd, events, MAX_EVENTS, -1);
     if(res < 0) {
-      /*
-       * La select ha fallito per qualche motivo, forse
-       * perchè è stata interrotta: se così fosse SHOULD_EXIT adesso
-       * è true e il programma deve terminare, oppure è stata richiesta la
-       * stampa delle statistiche, altrimenti ritenta la select
-       */
-      continue;
+      /* Interruzione spuria, ritenta la epoll_wait */
+      if(errno == EINTR) continue;
+      HANDLE_FATAL(res, "epoll_wait");
     }
 
-    for (long i = 0; i < FD_SETSIZE; ++i) {
-      if (FD_ISSET(i, &readSet)) {
-        if (i == fd_sk) {
-          /* Connessione da un nuovo client */
-          int newClient = accept(fd_sk, NULL, 0);
-          HANDLE_FATAL(newClient, "accept");
+    for(int i = 0; i < res; i++) {
+      long fd = events[i].data.fd;
+      if(fd == signal_fd) {
+        struct signalfd_siginfo info;
+        ssize_t r = read(signal_fd, &info, sizeof(info));
+        HANDLE_FATAL(r, "read");
+
+        if(info.ssi_signo == SIGUSR1) {
+          /* È stato ricevuto il segnale di scrittura delle statistiche */
+          FILE *statFile = fopen(cfg.statFileName, "a");
+          HANDLE_NULL(statFile, "fopen");
 
           MUTEX_GUARD(payload.stats_mtx, {
-            if(payload.chatty_stats.nonline >= cfg.maxConnections) {
-              /* Numero massimo di connessioni raggiunto, rifiuta la connessione */
-              LOG_ERR("Connessione di %d rifiutata", newClient);
-  
-              message_t errMsg;
-              make_error_message(&errMsg, OP_FAIL, NULL, "Server occupato");
-              sendRequest(newClient, &errMsg);
-              
-              free(errMsg.data.buf);
-  
-              payload.chatty_stats.nerrors++;
-            } else {
-              FD_SET(newClient, &(payload.set));
-            }
+            HANDLE_FATAL(printStats(statFile, &(payload.chatty_stats)), "printStats");
           });
+
+          fclose(statFile);
         } else {
-          /* Un client già connesso è pronto */
-          long *elem = calloc(1, sizeof(long));
-          HANDLE_NULL(elem, "calloc");
+          /* Segnale di terminazione, verrà gestito all'uscita dal ciclo */
+          signalStatus = info.ssi_signo;
+        }
+      } else if(fd == fd_sk) {
+        /* Connessione da un nuovo client */
+        int newClient = accept(fd_sk, NULL, 0);
+        HANDLE_FATAL(newClient, "accept");
+
+        int accepted = 0;
+        MUTEX_GUARD(payload.stats_mtx, {
+          if(payload.chatty_stats.nonline >= cfg.maxConnections) {
+            /* Numero massimo di connessioni raggiunto, rifiuta la connessione */
+            LOG_ERR("Connessione di %d rifiutata", newClient);
+
+            message_t errMsg;
+            make_error_message(&errMsg, OP_FAIL, NULL, "Server occupato");
+            sendRequest(newClient, &errMsg);
+
+            cslab_free(errMsg.data.buf);
+
+            payload.chatty_stats.nerrors++;
+          } else {
+            accepted = 1;
+          }
+        });
 
-          *elem = i;
-          MUTEX_GUARD(payload.set, {
-            FD_CLR(i, &payload.set);
-          });
-          cqueue_push(payload.ready_sockets, elem);
+        if(accepted) {
+          add_client(&payload, newClient);
+        } else {
+          close(newClient);
         }
+      } else {
+        /* Un client già connesso è pronto. Essendo registrato con
+           EPOLLONESHOT, non verrà più notificato finchè il thread che lo
+           gestisce non lo riattiva */
+        /* Il client viene sempre affidato allo stesso thread, che ne ha
+           i dati in cache, a meno che un altro thread non sia inattivo */
+        HANDLE_FATAL(csched_push(payload.ready_sockets, fd % cfg.threadsInPool, fd),
+                     "csched_push");
       }
     }
   }
 
-  /* Mette in coda un messaggio speciale per segnalare ai thread
-     di terminare */
-  cqueue_clear(payload.ready_sockets, free);
-  long *elem = calloc(1, sizeof(long));
-  HANDLE_NULL(elem, "calloc");
-  *elem = -1;
-  cqueue_push(payload.ready_sockets, elem);
+  if(cfg.dispatchMode == DISPATCH_QUEUE) {
+    /* Mette in coda un messaggio speciale per segnalare ai thread
+       di terminare */
+    long fd;
+    while(csched_try_pop(payload.ready_sockets, 0, &fd) == 0);
+    HANDLE_FATAL(csched_push(payload.ready_sockets, 0, -1), "csched_push");
+  }
+
+  /* Risveglia tutti gli event loop e il thread che svuota le code di uscita */
+  uint64_t one = 1;
+  HANDLE_FATAL(write(payload.wakeup_fd, &one, sizeof(one)), "write");
 
   printf("\nChiusura in corso... ");
 
@@ -421,6 +1039,36 @@ int main(int argc, char *argv[]) {
     pthread_join(threadPool[i], NULL);
   }
   free(threadPool);
+  free(workers);
+
+  if(fileThreadPool != NULL) {
+    /* Le operazioni già accodate vengono completate prima dell'uscita */
+    HANDLE_FATAL(cqueue_push(payload.file_jobs, NULL), "cqueue_push");
+    for(int i = 0; i < cfg.fileThreadsInPool; i++) {
+      pthread_join(fileThreadPool[i], NULL);
+    }
+    free(fileThreadPool);
+    HANDLE_FATAL(cqueue_deinit(payload.file_jobs, NULL), "cqueue_deinit");
+  }
+
+  /* Le operazioni affidate al pool e non ancora eseguite vengono
+     completate dal thread principale */
+  while(cqueue_size(payload.tasks) > 0) {
+    run_task(&payload);
+  }
+  HANDLE_FATAL(cqueue_deinit(payload.tasks, NULL), "cqueue_deinit");
+
+  /* I messaggi ancora in coda vengono scartati */
+  pthread_join(flusher, NULL);
+
+  if(payload.loops != NULL) {
+    for(int i = 0; i < cfg.threadsInPool; i++) {
+      close(payload.loops[i].epoll_fd);
+      close(payload.loops[i].ready_fd);
+      HANDLE_FATAL(cring_deinit(payload.loops[i].ready), "cring_deinit");
+    }
+    free(payload.loops);
+  }
   
   printf("fatto.\nPulizia in corso... ");
 
@@ -428,13 +1076,27 @@ int main(int argc, char *argv[]) {
   unlink(cfg.socketPath);
 
   /* Pulizia finale delle risorse allocate */
-  HANDLE_FATAL(chash_deinit(payload.registered_clients, free_client_descriptor), "chash_deinit");
+  HANDLE_FATAL(cintern_deinit(payload.users, free_client_descriptor), "cintern_deinit");
   HANDLE_FATAL(chash_deinit(payload.groups, free_group), "chash_deinit");
-  HANDLE_FATAL(cqueue_deinit(payload.ready_sockets, free), "cqueue_deinit");
+  /* Dealloca gli utenti deregistrati e i vettori delle tabelle sostituiti */
+  cebr_flush();
+  HANDLE_FATAL(csched_deinit(payload.ready_sockets), "csched_deinit");
   HANDLE_FATAL(pthread_mutex_destroy(&(payload.stats_mtx)), "pthread_mutex_destroy");
-  HANDLE_FATAL(pthread_mutex_destroy(&(payload.set_mtx)), "pthread_mutex_destroy");
-
-  free(payload.connected_clients);
+  HANDLE_FATAL(pthread_mutex_destroy(&(payload.connected_clients_mtx)), "pthread_mutex_destroy");
+  close(payload.epoll_fd);
+  close(payload.out_epoll_fd);
+  close(payload.wakeup_fd);
+  close(payload.task_fd);
+  close(signal_fd);
+
+  free(payload.online);
+  for(long i = 0; i < payload.max_fds; i++) {
+    msgbuf_free(&(payload.conns[i].in));
+    outqueue_destroy(&(payload.conns[i].out));
+  }
+  free(payload.conns);
+  /* Restituisce a free gli oggetti conservati dall'allocatore */
+  cslab_release();
   printf("fatto. Bye!\n");
   return 0;
 }
@@ -0,0 +1,390 @@
+/**
+ *  \file chatty_bench.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *  \brief Benchmark della latenza dei messaggi testuali
+ *
+ * Un client invia messaggi testuali brevi e misura il tempo che intercorre
+ * fra l'invio di ciascuna richiesta e la ricezione della risposta, mentre
+ * altri client inviano continuamente file di grandi dimensioni. Al termine
+ * vengono stampati i percentili della latenza e il numero di file inviati.
+ *
+ * Tutti i messaggi sono diretti ad un utente registrato ma non connesso,
+ * in modo che il server non debba recapitarli immediatamente.
+ *
+ * Con l'opzione -c il benchmark misura invece la contesa fra i thread del
+ * server: più client connessi contemporaneamente si inviano messaggi a
+ * vicenda, e viene stampato il numero di messaggi consegnati al secondo.
+ * Eseguito con valori diversi di ThreadsInPool, mostra quanto il server
+ * scala con il numero di thread.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "connections.h"
+#include "message.h"
+#include "errman.h"
+
+/// Nickname dell'utente a cui sono diretti tutti i messaggi
+#define SINK_NICK "bench_sink"
+
+/**
+ * \brief Parametri del benchmark
+ */
+struct bench_cfg {
+  char *path; ///< Path del socket del server
+  int fileClients; ///< Numero di client che inviano file
+  size_t fileSize; ///< Dimensione dei file inviati, in byte
+  int messages; ///< Numero di messaggi testuali da inviare
+  long interval; ///< Intervallo fra due messaggi testuali, in microsecondi
+  int chatClients; ///< Numero di client che si inviano messaggi (0: benchmark della latenza)
+};
+
+/**
+ * \brief Contesto di un client che invia file
+ */
+typedef struct {
+  struct bench_cfg *cfg; ///< Parametri del benchmark
+  int id; ///< Indice del client
+  char *file; ///< Contenuto del file da inviare
+  long sent; ///< Numero di file inviati
+} file_client_t;
+
+/**
+ * \brief Contesto di un client del benchmark di contesa
+ */
+typedef struct {
+  struct bench_cfg *cfg; ///< Parametri del benchmark
+  int id; ///< Indice del client
+  pthread_barrier_t *start; ///< Sincronizza l'inizio e la fine degli invii
+} chat_client_t;
+
+/// Diventa 1 quando i client che inviano file devono terminare
+static int stop = 0;
+
+static void usage(const char *progname) {
+  fprintf(stderr, "Il server va lanciato prima del benchmark\n");
+  fprintf(stderr, "Usa: %s -l unix_path [-f client_file] [-z dim_file_KB] "
+                  "[-n messaggi] [-i intervallo_us]\n", progname);
+  fprintf(stderr, "     %s -l unix_path -c client [-n messaggi_per_client]\n", progname);
+}
+
+/**
+ * \brief Restituisce il tempo corrente in microsecondi
+ */
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * \brief Attende la risposta del server ad una richiesta
+ *
+ * \param fd Il descrittore della connessione
+ * \param withData 1 se una risposta positiva contiene anche dati
+ * \return int L'operazione ricevuta, -1 in caso di errore
+ */
+static int read_reply(int fd, int withData) {
+  message_hdr_t hdr;
+  if(readHeader(fd, &hdr) <= 0) return -1;
+
+  if(hdr.op != OP_OK || withData) {
+    /* Gli errori contengono sempre un testo */
+    message_data_t data;
+    memset(&data, 0, sizeof(data));
+    if(readData(fd, &data) <= 0) return -1;
+    free(data.buf);
+  }
+
+  return hdr.op;
+}
+
+/**
+ * \brief Attende l'ack di una richiesta, scartando i messaggi ricevuti
+ *        nel frattempo dagli altri client
+ *
+ * \param fd Il descrittore della connessione
+ * \return int L'operazione ricevuta, -1 in caso di errore
+ */
+static int read_ack(int fd) {
+  for(;;) {
+    message_hdr_t hdr;
+    if(readHeader(fd, &hdr) <= 0) return -1;
+
+    if(hdr.op == OP_OK) return hdr.op;
+
+    message_data_t data;
+    memset(&data, 0, sizeof(data));
+    if(readData(fd, &data) <= 0) return -1;
+    free(data.buf);
+
+    if(hdr.op != TXT_MESSAGE) return hdr.op;
+  }
+}
+
+/**
+ * \brief Apre una connessione e si connette come \p nick,
+ *        registrandolo se necessario
+ *
+ * \param cfg Parametri del benchmark
+ * \param nick Il nickname da usare
+ * \return int Il descrittore della connessione
+ */
+static int login(struct bench_cfg *cfg, char *nick) {
+  int fd = openConnection(cfg->path, 10, 1);
+  HANDLE_FATAL(fd, "openConnection");
+
+  message_t msg;
+  setHeader(&msg.hdr, REGISTER_OP, nick);
+  setData(&msg.data, "", NULL, 0);
+  HANDLE_FATAL(sendRequest(fd, &msg), "sendRequest");
+
+  int op = read_reply(fd, 1);
+  if(op == OP_NICK_ALREADY) {
+    /* Registrato da un'esecuzione precedente */
+    setHeader(&msg.hdr, CONNECT_OP, nick);
+    HANDLE_FATAL(sendRequest(fd, &msg), "sendRequest");
+    op = read_reply(fd, 1);
+  }
+
+  if(op != OP_OK) {
+    fprintf(stderr, "Impossibile connettersi come %s (%d)\n", nick, op);
+    exit(EXIT_FAILURE);
+  }
+
+  return fd;
+}
+
+/**
+ * \brief Invia continuamente file finchè \ref stop non diventa 1
+ *
+ * \param data Contesto del client (\ref file_client_t*)
+ * \return void* Sempre NULL
+ */
+static void *file_client(void *data) {
+  file_client_t *fc = (file_client_t*)data;
+  char nick[MAX_NAME_LENGTH + 1];
+  char fileName[64];
+  snprintf(nick, sizeof(nick), "bench_file%d", fc->id);
+  snprintf(fileName, sizeof(fileName), "bench_file%d.bin", fc->id);
+
+  int fd = login(fc->cfg, nick);
+
+  while(!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    message_t msg;
+    setHeader(&msg.hdr, POSTFILE_OP, nick);
+    setData(&msg.data, SINK_NICK, fileName, strlen(fileName) + 1);
+    HANDLE_FATAL(sendRequest(fd, &msg), "sendRequest");
+
+    message_data_t file;
+    setData(&file, "", fc->file, fc->cfg->fileSize);
+    HANDLE_FATAL(sendData(fd, &file), "sendData");
+
+    int op = read_reply(fd, 0);
+    if(op != OP_OK) {
+      fprintf(stderr, "Invio del file fallito (%d)\n", op);
+      exit(EXIT_FAILURE);
+    }
+    fc->sent++;
+  }
+
+  close(fd);
+  return NULL;
+}
+
+/**
+ * \brief Invia messaggi al client successivo, attendendo l'ack di ognuno
+ *
+ * \param data Contesto del client (\ref chat_client_t*)
+ * \return void* Sempre NULL
+ */
+static void *chat_client(void *data) {
+  chat_client_t *cc = (chat_client_t*)data;
+  char nick[MAX_NAME_LENGTH + 1], peer[MAX_NAME_LENGTH + 1];
+  snprintf(nick, sizeof(nick), "bench_c%d", cc->id);
+  snprintf(peer, sizeof(peer), "bench_c%d", (cc->id + 1) % cc->cfg->chatClients);
+
+  int fd = login(cc->cfg, nick);
+  pthread_barrier_wait(cc->start);
+
+  for(int i = 0; i < cc->cfg->messages; i++) {
+    message_t msg;
+    setHeader(&msg.hdr, POSTTXT_OP, nick);
+    setData(&msg.data, peer, "ping", 5);
+    HANDLE_FATAL(sendRequest(fd, &msg), "sendRequest");
+
+    int op = read_ack(fd);
+    if(op != OP_OK) {
+      fprintf(stderr, "Invio del messaggio fallito (%d)\n", op);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Attende che tutti abbiano terminato prima di disconnettersi, in modo
+     che i messaggi vengano sempre recapitati */
+  pthread_barrier_wait(cc->start);
+  close(fd);
+  return NULL;
+}
+
+/**
+ * \brief Esegue il benchmark di contesa
+ *
+ * \param cfg Parametri del benchmark
+ * \return int 0 in caso di successo
+ */
+static int run_contention(struct bench_cfg *cfg) {
+  int n = cfg->chatClients;
+  chat_client_t *ccs = calloc(n, sizeof(chat_client_t));
+  pthread_t *threads = calloc(n, sizeof(pthread_t));
+  HANDLE_NULL(ccs, "calloc");
+  HANDLE_NULL(threads, "calloc");
+
+  /* Il thread principale partecipa alla barriera per misurare il tempo */
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, n + 1);
+
+  for(int i = 0; i < n; i++) {
+    ccs[i].cfg = cfg;
+    ccs[i].id = i;
+    ccs[i].start = &start;
+    pthread_create(threads + i, NULL, chat_client, ccs + i);
+  }
+
+  pthread_barrier_wait(&start);
+  double t0 = now_us();
+  pthread_barrier_wait(&start);
+  double elapsed = (now_us() - t0) / 1e6;
+
+  for(int i = 0; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  long sent = (long)n * cfg->messages;
+  printf("Client: %d, messaggi inviati: %ld\n", n, sent);
+  printf("  durata:     %10.3f s\n", elapsed);
+  printf("  throughput: %10.0f msg/s\n", sent / elapsed);
+
+  pthread_barrier_destroy(&start);
+  free(threads);
+  free(ccs);
+  return 0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * \brief Restituisce il percentile \p p di un vettore ordinato
+ */
+static double percentile(double *sorted, int n, double p) {
+  int idx = (int)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[idx];
+}
+
+/** Funzione d'entrata */
+int main(int argc, char *argv[]) {
+  struct bench_cfg cfg = { NULL, 4, 512 * 1024, 2000, 1000, 0 };
+
+  int opt;
+  while((opt = getopt(argc, argv, "l:f:z:n:i:c:")) != -1) {
+    switch(opt) {
+    case 'l': cfg.path = optarg; break;
+    case 'f': cfg.fileClients = atoi(optarg); break;
+    case 'z': cfg.fileSize = (size_t)atol(optarg) * 1024; break;
+    case 'n': cfg.messages = atoi(optarg); break;
+    case 'i': cfg.interval = atol(optarg); break;
+    case 'c': cfg.chatClients = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if(cfg.path == NULL || cfg.fileClients < 0 || cfg.messages <= 0 || cfg.chatClients < 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if(cfg.chatClients > 0) {
+    return run_contention(&cfg);
+  }
+
+  /* Registra il destinatario e lo disconnette */
+  close(login(&cfg, SINK_NICK));
+
+  char *file = malloc(cfg.fileSize);
+  HANDLE_NULL(file, "malloc");
+  memset(file, 'x', cfg.fileSize);
+
+  file_client_t *fcs = calloc(cfg.fileClients, sizeof(file_client_t));
+  pthread_t *threads = calloc(cfg.fileClients, sizeof(pthread_t));
+  double *lat = calloc(cfg.messages, sizeof(double));
+  HANDLE_NULL(fcs, "calloc");
+  HANDLE_NULL(threads, "calloc");
+  HANDLE_NULL(lat, "calloc");
+
+  double start = now_us();
+  for(int i = 0; i < cfg.fileClients; i++) {
+    fcs[i].cfg = &cfg;
+    fcs[i].id = i;
+    fcs[i].file = file;
+    pthread_create(threads + i, NULL, file_client, fcs + i);
+  }
+
+  int fd = login(&cfg, "bench_chat");
+  struct timespec pause = { cfg.interval / 1000000, (cfg.interval % 1000000) * 1000 };
+  for(int i = 0; i < cfg.messages; i++) {
+    message_t msg;
+    setHeader(&msg.hdr, POSTTXT_OP, "bench_chat");
+    setData(&msg.data, SINK_NICK, "ping", 5);
+
+    double t0 = now_us();
+    HANDLE_FATAL(sendRequest(fd, &msg), "sendRequest");
+    int op = read_reply(fd, 0);
+    lat[i] = now_us() - t0;
+
+    if(op != OP_OK) {
+      fprintf(stderr, "Invio del messaggio fallito (%d)\n", op);
+      return -1;
+    }
+
+    if(cfg.interval > 0) nanosleep(&pause, NULL);
+  }
+  close(fd);
+
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  long files = 0;
+  for(int i = 0; i < cfg.fileClients; i++) {
+    pthread_join(threads[i], NULL);
+    files += fcs[i].sent;
+  }
+  double elapsed = (now_us() - start) / 1e6;
+
+  qsort(lat, cfg.messages, sizeof(double), cmp_double);
+  printf("Messaggi testuali: %d\n", cfg.messages);
+  printf("  latenza p50: %10.1f us\n", percentile(lat, cfg.messages, 50));
+  printf("  latenza p90: %10.1f us\n", percentile(lat, cfg.messages, 90));
+  printf("  latenza p99: %10.1f us\n", percentile(lat, cfg.messages, 99));
+  printf("  latenza max: %10.1f us\n", lat[cfg.messages - 1]);
+  printf("File inviati da %d client: %ld (%.1f MB/s)\n", cfg.fileClients, files,
+         files * (cfg.fileSize / 1048576.0) / elapsed);
+
+  free(lat);
+  free(threads);
+  free(fcs);
+  free(file);
+  return 0;
+}
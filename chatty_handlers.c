@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -16,6 +17,13 @@
 #include "errman.h"
 #include "connections.h"
 #include "chatty_handlers.h"
+#include "cebr.h"
+#include "cslab.h"
+
+/// Numero massimo di destinatari serviti da una singola operazione: i
+/// messaggi diretti a più utenti vengono suddivisi in blocchi di questa
+/// dimensione, consegnati in parallelo dai thread del pool
+#define FANOUT_BATCH 64
 
 /// Aumenta in maniera atomica il numero di errori inviati
 #define INCREASE_ERRORS(pl) MUTEX_GUARD((pl)->stats_mtx, { (pl)->chatty_stats.nerrors++; });
@@ -37,73 +45,121 @@ void make_error_message(message_t *msg, op_t error, const char *receiver, const
   if(text != NULL) {
     size_t len = strlen(text);
     msg->data.hdr.len = len;
-    msg->data.buf = calloc(len + 1, sizeof(char));
-    strncpy(msg->data.buf, text, len);
+    msg->data.buf = cslab_alloc(len + 1);
+    HANDLE_NULL(msg->data.buf, "cslab_alloc");
+    memcpy(msg->data.buf, text, len + 1);
   }
 }
 
 /**
- * \brief Invia un messaggio ad un client e gestisce automaticamente l'evenutale disconnessione
+ * \brief Invia dei messaggi ad un client tramite la sua coda di uscita
  * 
- * \warning Se questa procedura viene chiamata da una funzione di callback eseguita
- *          su \ref payload_t.registered_clients, \p client non può essere NULL
+ * I messaggi vengono scritti subito se il socket lo consente, altrimenti
+ * vengono accodati e inviati quando il client torna a leggere. Se la coda è
+ * piena, a seconda di \ref server_cfg.outQueuePolicy i messaggi vengono
+ * scartati oppure il client viene disconnesso.
  * 
- * \param fd Descrittore a cui inviare il messaggio
- * \param msg Il messaggio da inviare
+ * \param fd Descrittore a cui inviare i messaggi
+ * \param gen Generazione della connessione destinataria, \ref OUTQUEUE_ANY_GEN
+ *            se \p fd è il client di cui si sta servendo la richiesta
+ * \param msgs I messaggi da inviare
+ * \param shared I messaggi condivisi che contengono i dati di \p msgs, i cui
+ *               dati non vengono quindi copiati (opzionale)
+ * \param n Il numero di messaggi
+ * \param header_only 1 se va inviato solamente l'header dei messaggi
  * \param pl Dati di contesto
- * \param client Il descrittore del client da disconnettere se già estratto
- *               dalla tabella hash, altrimenti NULL
  * \return int 0 se il client si è disconnesso, -1 in caso di errore (ed errno impostato), altro altrimenti
  */
-static int send_handle_disconnect(long fd, message_t *msg, payload_t *pl, client_descriptor_t *client) {
-  int ret = sendRequest(fd, msg);
-  if(ret == 0 || HAS_DISCONNECTED(ret)) {
-    LOG_ERR("%s", strerror(errno));
-    disconnect_client(fd, pl, client);
-    ret = 0;
+static int queue_send(long fd, unsigned int gen, message_t **msgs, cmessage_t **shared, int n, int header_only, payload_t *pl) {
+  if(fd < 0 || fd >= pl->max_fds) return 0;
+
+  int ret = outqueue_send(&(pl->conns[fd].out), fd, gen, pl->out_epoll_fd,
+                          pl->cfg->maxOutQueue, pl->cfg->outQueuePolicy,
+                          msgs, shared, n, header_only);
+  if(ret < 0 && errno == ENOBUFS) {
+    /* Il client è lento ma resta connesso, solo questi messaggi vanno persi */
+    LOG_WARN("Coda di uscita del client %ld piena, messaggio scartato", fd);
+    ret = 1;
   }
 
   return ret;
 }
 
 /**
- * \brief Invia un header ad un client e gestisce automaticamente l'evenutale disconnessione
+ * \brief Invia un messaggio ad un client
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
+ * \param fd Descrittore a cui inviare il messaggio
+ * \param msg Il messaggio da inviare
+ * \param pl Dati di contesto
+ * \return int 0 se il client si è disconnesso, -1 in caso di errore (ed errno impostato), altro altrimenti
+ */
+static int send_message(long fd, message_t *msg, payload_t *pl) {
+  return queue_send(fd, OUTQUEUE_ANY_GEN, &msg, NULL, 1, 0, pl);
+}
+
+/**
+ * \brief Invia un messaggio condiviso ad un client, senza copiarne i dati
  * 
- * \warning Se questa procedura viene chiamata da una funzione di callback eseguita
- *          su \ref payload_t.registered_clients, \p client non può essere NULL
+ * \param conn Descrittore e generazione del destinatario (\ref CONN_HANDLE)
+ * \param op L'operazione con cui inviare il messaggio
+ * \param shared Il messaggio da inviare
+ * \param pl Dati di contesto
+ * \return int 0 se il client si è disconnesso, -1 in caso di errore (ed errno impostato), altro altrimenti
+ */
+static int send_shared(long conn, op_t op, cmessage_t *shared, payload_t *pl) {
+  /* Il messaggio condiviso è immutabile, se ne copia solo l'header */
+  message_t msg = shared->msg;
+  message_t *msgs = &msg;
+  msg.hdr.op = op;
+
+  return queue_send(CONN_FD(conn), CONN_GEN(conn), &msgs, &shared, 1, 0, pl);
+}
+
+/**
+ * \brief Invia più messaggi ad un client con una sola scrittura
+ * 
+ * \param fd Descrittore a cui inviare i messaggi
+ * \param msgs I messaggi da inviare
+ * \param shared I messaggi condivisi che contengono i dati di \p msgs (opzionale)
+ * \param n Il numero di messaggi
+ * \param pl Dati di contesto
+ * \return int 0 se il client si è disconnesso, -1 in caso di errore (ed errno impostato), altro altrimenti
+ */
+static int send_batch(long fd, message_t **msgs, cmessage_t **shared, int n, payload_t *pl) {
+  return queue_send(fd, OUTQUEUE_ANY_GEN, msgs, shared, n, 0, pl);
+}
+
+/**
+ * \brief Invia un header ad un client
  * 
  * \param fd Descrittore a cui inviare l'header
  * \param msg L'header da inviare
  * \param pl Dati di contesto
- * \param client Il descrittore del client da disconnettere se già estratto
- *               dalla tabella hash, altrimenti NULL
  * \return int 0 se il client si è disconnesso, -1 in caso di errore (ed errno impostato), altro altrimenti
  */
-static int send_header_handle_disconnect(long fd, message_hdr_t *msg, payload_t *pl, client_descriptor_t *client) {
-  int ret = sendHeader(fd, msg);
-  if(ret == 0 || HAS_DISCONNECTED(ret)) {
-    LOG_ERR("%s", strerror(errno));
-    disconnect_client(fd, pl, client);
-    ret = 0;
-  }
+static int send_header(long fd, message_hdr_t *msg, payload_t *pl) {
+  message_t m;
+  message_t *msgs = &m;
+  m.hdr = *msg;
 
-  return ret;
+  return queue_send(fd, OUTQUEUE_ANY_GEN, &msgs, NULL, 1, 1, pl);
 }
 
-int send_error_message(long fd, op_t error, payload_t *pl, const char *receiver, const char *text, client_descriptor_t *client) {
+int send_error_message(long fd, op_t error, payload_t *pl, const char *receiver, const char *text) {
   message_t errMsg;
-  make_error_message(&errMsg, error, receiver, text);
+  make_error_message(&errMsg, error, receiver, NULL);
+  if(text != NULL) {
+    /* Il testo viene solo letto durante l'invio, e se accodato viene
+       copiato: non serve allocarne una copia */
+    errMsg.data.buf = (char*)text;
+    errMsg.data.hdr.len = strlen(text);
+  }
 
-  int ret = send_handle_disconnect(fd, &errMsg, pl, client);
+  int ret = send_message(fd, &errMsg, pl);
   HANDLE_FATAL(ret, "Inviando un errore");
 
   INCREASE_ERRORS(pl);
 
-  if(errMsg.data.buf) free(errMsg.data.buf);
-
   return ret;
 }
 
@@ -111,59 +167,144 @@ int send_error_message(long fd, op_t error, payload_t *pl, const char *receiver,
  * \brief Viene utilizzata da \ref disconnect_client per disassociare un socket
  *        da un nome utente
  * 
+ * \param id L'identificatore dell'utente da disassociare
  * \param key Il nome utente da disassociare
  * \param value Il descrittore da disassociare (\ref client_descriptor_t*)
- * \param ud Contesto di lavoro (\ref payload_t*)
+ * \param ud Il socket che si è disconnesso (long*)
  */
-static void disconnect_client_cb(const char *key, void *value, void *ud) {
+static void disconnect_client_cb(cintern_id_t id, const char *key, void *value, void *ud) {
   assert(ud != NULL);
 
   if(value == NULL) {
     return;
   }
 
+  LOG_INFO("Disconnessione di '%s'", key);
+
+  /* Nel frattempo l'utente potrebbe essersi riconnesso con un altro socket */
   client_descriptor_t *cd = (client_descriptor_t*)value;
-  cd->fd = -1;
+  long fd = *(long*)ud;
+  long conn = __atomic_load_n(&(cd->conn), __ATOMIC_RELAXED);
+  while(CONN_FD(conn) == fd &&
+        !__atomic_compare_exchange_n(&(cd->conn), &conn, -1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 }
 
 /**
- * \brief Restituisce il client associato al descrittore \p fd
+ * \brief Restituisce la connessione di un client connesso
  * 
  * \warning Questa procedura presuppone che il chiamante abbia bloccato
  *          \ref payload_t.connected_clients_mtx
  * 
  * \param fd Il descrittore da cercare
  * \param pl Dati di contesto
- * \return connected_client_t* Il client trovato.
- *                             NULL se \p fd non si riferisce ad alcun client connesso
+ * \return connection_t* La connessione di \p fd.
+ *                       NULL se \p fd non si riferisce ad alcun client connesso
+ */
+static connection_t *find_connected_client(long fd, payload_t *pl) {
+  if(fd < 0 || fd >= pl->max_fds || pl->conns[fd].online_idx < 0) {
+    return NULL;
+  }
+  return &(pl->conns[fd]);
+}
+
+/**
+ * \brief Restituisce l'utente con cui è connesso il client associato al
+ *        descrittore \p fd
+ * 
+ * \param fd Il descrittore da cercare
+ * \param pl Dati di contesto
+ * \return cintern_id_t L'identificatore dell'utente, \ref CINTERN_NONE se
+ *                      \p fd non si riferisce ad un client connesso
  */
-static int find_connected_client(long fd, payload_t *pl) {
-  for(int i = 0; i < pl->cfg->maxConnections; i++) {
-    connected_client_t *client = &(pl->connected_clients[i]);
-    if(client->fd == fd) {
-      return i;
+static cintern_id_t get_connected_user(long fd, payload_t *pl) {
+  cintern_id_t user = CINTERN_NONE;
+  MUTEX_GUARD(pl->connected_clients_mtx, {
+    connection_t *conn = find_connected_client(fd, pl);
+    if(conn != NULL) {
+      user = conn->user;
     }
+  });
+  return user;
+}
+
+/**
+ * \brief Copia il nickname del client associato al descrittore \p fd
+ * 
+ * \param fd Il descrittore da cercare
+ * \param pl Dati di contesto
+ * \param nick Dove copiare il nickname (almeno MAX_NAME_LENGTH + 1 caratteri)
+ * \return int 1 se \p fd si riferisce ad un client connesso con un utente
+ *             ancora registrato, 0 altrimenti
+ */
+static int get_connected_nick(long fd, payload_t *pl, char *nick) {
+  cintern_id_t user = get_connected_user(fd, pl);
+  return user != CINTERN_NONE && cintern_name(pl->users, user, nick, MAX_NAME_LENGTH + 1);
+}
+
+/**
+ * \brief Aggiunge \p fd ai client connessi con l'utente \p user
+ * 
+ * \warning Questa procedura presuppone che il chiamante abbia bloccato
+ *          \ref payload_t.connected_clients_mtx
+ * 
+ * \return int 1 se il client è stato aggiunto, 0 se era già connesso (ne
+ *             viene solo aggiornato l'utente), -1 se non c'è più spazio
+ */
+static int add_connected_client(long fd, payload_t *pl, cintern_id_t user) {
+  connection_t *conn = &(pl->conns[fd]);
+  int added = 0;
+  if(conn->online_idx < 0) {
+    if(pl->nonline >= pl->cfg->maxConnections) return -1;
+
+    conn->online_idx = pl->nonline;
+    pl->online[pl->nonline++] = fd;
+    added = 1;
   }
-  return -1;
+
+  conn->user = user;
+  return added;
+}
+
+/**
+ * \brief Rimuove una connessione dai client connessi, spostando l'ultimo
+ *        client connesso al suo posto
+ * 
+ * \warning Questa procedura presuppone che il chiamante abbia bloccato
+ *          \ref payload_t.connected_clients_mtx
+ */
+static void remove_connected_client(connection_t *conn, payload_t *pl) {
+  long last = pl->online[--pl->nonline];
+  pl->online[conn->online_idx] = last;
+  pl->conns[last].online_idx = conn->online_idx;
+
+  conn->online_idx = -1;
+  conn->user = CINTERN_NONE;
 }
 
 void disconnect_client(long fd, payload_t *pl, client_descriptor_t *client) {
-  int clientIdx = find_connected_client(fd, pl);
-  if(clientIdx != -1) {
-    LOG_INFO("Disconnessione di '%s'", pl->connected_clients[clientIdx].nick);
+  cintern_id_t user = CINTERN_NONE;
+
+  /* Il client viene rimosso dai connessi con il mutex acquisito, il
+     descrittore dell'utente viene aggiornato dopo averlo rilasciato */
+  int found = 0;
+  MUTEX_GUARD(pl->connected_clients_mtx, {
+    connection_t *conn = find_connected_client(fd, pl);
+    if(conn != NULL) {
+      user = conn->user;
+      remove_connected_client(conn, pl);
+      found = 1;
+    }
+  });
 
+  if(found) {
     if(client == NULL) {
-      int ret = chash_get(pl->registered_clients,
-                          pl->connected_clients[clientIdx].nick,
-                          disconnect_client_cb, pl);
-      HANDLE_FATAL(ret, "chash_get");
+      int ret = cintern_get(pl->users, user, disconnect_client_cb, &fd);
+      HANDLE_FATAL(ret, "cintern_get");
     } else {
-      client->fd = -1;
+      LOG_INFO("Disconnessione del client %ld", fd);
+      __atomic_store_n(&(client->conn), -1, __ATOMIC_RELAXED);
     }
 
-    pl->connected_clients[clientIdx].nick[0] = '\0';
-    pl->connected_clients[clientIdx].fd = -1;
-
     MUTEX_GUARD(pl->stats_mtx, {
       if(pl->chatty_stats.nonline > 0)
         pl->chatty_stats.nonline--;
@@ -174,30 +315,34 @@ void disconnect_client(long fd, payload_t *pl, client_descriptor_t *client) {
 /**
  * \brief Invia la lista degli utenti registrati
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
- * 
- * \warning Se questa procedura viene chiamata da una funzione di callback eseguita
- *          su \ref payload_t.registered_clients, \p client non può essere NULL
- * 
  * \param fd Il client a cui inviare la lista
  * \param pl Dati di contesto
- * \param client Il client da disconnettere se già estratto dalla tabella hash,
- *               altrimenti NULL
  * 
  * \return int 0 se \p fd si è disconnesso durante l'operazione, 1 altrimenti
  */
-static int send_user_list(int fd, payload_t *pl, client_descriptor_t *client) {
+static int send_user_list(int fd, payload_t *pl) {
   char *buf = NULL;
   int c = 0;
 
   /* Alloca un buffer per mantenere il vettore con i nickname degli utenti
-     registrati */
-  buf = calloc(sizeof(char) * (MAX_NAME_LENGTH + 1), pl->cfg->maxConnections);
-  for(int i = 0; i < pl->cfg->maxConnections; i++) {
-    connected_client_t client = pl->connected_clients[i];
-    if(client.fd > 0 && client.nick[0] != '\0') {
-      strncpy(buf + (MAX_NAME_LENGTH + 1) * c, client.nick, MAX_NAME_LENGTH);
+     registrati. Entrambi i vettori vivono solo per la durata della richiesta */
+  buf = carena_calloc(request_arena(), sizeof(char) * (MAX_NAME_LENGTH + 1), pl->cfg->maxConnections);
+  HANDLE_NULL(buf, "carena_calloc");
+  cintern_id_t *users = carena_alloc(request_arena(), pl->cfg->maxConnections * sizeof(cintern_id_t));
+  HANDLE_NULL(users, "carena_alloc");
+
+  /* Gli identificatori vengono copiati con il mutex acquisito, e convertiti
+     in nickname dopo averlo rilasciato. Gli utenti deregistrati nel
+     frattempo vengono saltati */
+  int n = 0;
+  MUTEX_GUARD(pl->connected_clients_mtx, {
+    for(n = 0; n < pl->nonline; n++) {
+      users[n] = pl->conns[pl->online[n]].user;
+    }
+  });
+
+  for(int i = 0; i < n; i++) {
+    if(cintern_name(pl->users, users[i], buf + (MAX_NAME_LENGTH + 1) * c, MAX_NAME_LENGTH + 1)) {
       c++;
     }
   }
@@ -210,10 +355,8 @@ static int send_user_list(int fd, payload_t *pl, client_descriptor_t *client) {
 
   int ret;
 
-  ret = send_handle_disconnect(fd, &msg, pl, client);
-  HANDLE_FATAL(ret, "send_handle_disconnect");
-  
-  free(buf);
+  ret = send_message(fd, &msg, pl);
+  HANDLE_FATAL(ret, "send_message");
   
   return ret;
 }
@@ -231,14 +374,12 @@ struct callback_data {
 /**
  * \brief Viene utilizzata da \ref handle_connect per associare un socket a un nome utente
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
- * 
+ * \param id L'identificatore dell'utente da associare
  * \param key Il nome utente da associare
  * \param value Descrittore del client da associare (\ref client_descriptor_t*)
  * \param ud Contesto di lavoro (\ref callback_data*)
  */
-static void handle_connect_cb(const char *key, void *value, void *ud) {
+static void handle_connect_cb(cintern_id_t id, const char *key, void *value, void *ud) {
   assert(ud != NULL);
   struct callback_data *data = (struct callback_data*)ud;
 
@@ -249,36 +390,33 @@ static void handle_connect_cb(const char *key, void *value, void *ud) {
 
     INCREASE_ERRORS(data->pl);
 
-    *(data->is_connected) |= send_error_message(fd, OP_NICK_UNKNOWN, data->pl, NULL, "Nickname non esistente", NULL);
+    *(data->is_connected) |= send_error_message(fd, OP_NICK_UNKNOWN, data->pl, NULL, "Nickname non esistente");
     return;
   } else {
     client_descriptor_t *cd = (client_descriptor_t *)value;
     
-    cd->fd = fd;
-    /* Cerca il primo slot libero in cui inserire il nuovo client che si è
-       appena connesso */
-    for(int i = 0; i < data->pl->cfg->maxConnections; i++) {
-      connected_client_t *client = &(data->pl->connected_clients[i]);
-      if(client->fd < 0) {
-        LOG_INFO("Utente '%s' connesso", key);
-        client->fd = fd;
-        memset(client->nick, 0, MAX_NAME_LENGTH + 1);
-        strncpy(client->nick, key, MAX_NAME_LENGTH);
-
-        *(data->is_connected) |= send_user_list(fd, data->pl, cd);
-
-        /* Aggiorna il numero di client online */
-        MUTEX_GUARD(data->pl->stats_mtx, {
-          data->pl->chatty_stats.nonline++;
-        });
-
-        return;
-      }
+    /* Il descrittore è quello della richiesta in corso, per cui la sua
+       coda resta aperta almeno fino al termine della richiesta */
+    unsigned int gen = outqueue_generation(&(data->pl->conns[fd].out));
+    __atomic_store_n(&(cd->conn), CONN_HANDLE(fd, gen), __ATOMIC_RELAXED);
+    int inserted = 0;
+    MUTEX_GUARD(data->pl->connected_clients_mtx, {
+      inserted = add_connected_client(fd, data->pl, id);
+    });
+
+    /* Lo spazio deve sempre esistere, perchè il controllo sul
+       numero di client connessi viene effettuato prima */
+    assert(inserted >= 0);
+    LOG_INFO("Utente '%s' connesso", key);
+
+    if(inserted) {
+      /* Aggiorna il numero di client online */
+      MUTEX_GUARD(data->pl->stats_mtx, {
+        data->pl->chatty_stats.nonline++;
+      });
     }
 
-    /* Questo punto non dovrebbe essere mai raggiunto, perchè il controllo
-       sul numero di slot liberi viene effettuato prima */
-    assert(0);
+    *(data->is_connected) |= send_user_list(fd, data->pl);
   }
 }
 
@@ -299,10 +437,8 @@ static void handle_connect(long fd, message_t *msg, payload_t *pl, int *is_conne
   data.fd = fd;
   data.is_connected = is_connected;
   
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    int ret = chash_get(pl->registered_clients, msg->hdr.sender, handle_connect_cb, &data);
-    HANDLE_FATAL(ret, "chash_get");
-  });
+  int ret = cintern_lookup(pl->users, msg->hdr.sender, handle_connect_cb, &data);
+  HANDLE_FATAL(ret, "cintern_lookup");
 }
 
 /**
@@ -322,21 +458,20 @@ static void handle_register(long fd, message_t *msg, payload_t *pl, int *is_conn
   cd->message_buffer = ccircbuf_init(pl->cfg->maxHistMsgs);
   HANDLE_NULL(cd->message_buffer, "ccircbuf_init");
 
-  cd->fd = -1;
+  cd->conn = -1;
+  HANDLE_FATAL(pthread_mutex_init(&(cd->groups_mtx), NULL), "pthread_mutex_init");
 
   /* Inserisce il nick nella hashtable solo se non erano già presenti valori
     con la stessa chiave */
-  int res = chash_set_if_empty(pl->registered_clients, msg->hdr.sender, cd);
-  HANDLE_FATAL(res, "chash_set_if_empty");
+  int res = cintern_add(pl->users, msg->hdr.sender, cd, NULL);
+  HANDLE_FATAL(res, "cintern_add");
 
   if(res != 0) {
     /* Il nickname era già registrato */
     LOG_WARN("Tentativo di registrazione di '%s' fallito", msg->hdr.sender);
 
     INCREASE_ERRORS(pl);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_NICK_ALREADY, pl, NULL, "Nickname già registrato", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_NICK_ALREADY, pl, NULL, "Nickname già registrato");
 
     free_client_descriptor(cd);
   } else {
@@ -352,24 +487,20 @@ static void handle_register(long fd, message_t *msg, payload_t *pl, int *is_conn
     data.fd = fd;
     data.is_connected = is_connected;
     
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      int ret = chash_get(pl->registered_clients, msg->hdr.sender, handle_connect_cb, &data);
-      HANDLE_FATAL(ret, "chash_get");
-    });
+    int ret = cintern_lookup(pl->users, msg->hdr.sender, handle_connect_cb, &data);
+    HANDLE_FATAL(ret, "cintern_lookup");
   }
 }
 
 /**
  * \brief Instrada un messaggio verso un client
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
- * 
+ * \param id L'identificatore dell'utente verso cui instradare il messaggio
  * \param key Il nome utente del client verso cui instradare il messaggio
  * \param value Puntatore al descrittore del client verso cui instradare
  * \param ud Puntatore al pacchetto da instradare
  */
-static void route_message_to_client(const char *key, void *value, void *ud) {
+static void route_message_to_client(cintern_id_t id, const char *key, void *value, void *ud) {
   client_descriptor_t *client = (client_descriptor_t*)value;
   message_packet_t *pkt = (message_packet_t*)ud;
 
@@ -385,50 +516,50 @@ static void route_message_to_client(const char *key, void *value, void *ud) {
     LOG_WARN("'%s' ha tentato di inviare un messaggio ad un utente inesistente ('%s')",
       pkt->message.hdr.sender, key);
     
-    *(pkt->is_connected) |= send_error_message(pkt->fd, OP_NICK_UNKNOWN, pkt->pl, key, "Nickname non esistente", client);
+    *(pkt->is_connected) |= send_error_message(pkt->fd, OP_NICK_UNKNOWN, pkt->pl, key, "Nickname non esistente");
   } else {
+    /* Il descrittore può essere modificato in parallelo dalla connessione
+       o disconnessione dell'utente, e riassegnato ad un altro client:
+       l'invio verifica la generazione con la coda bloccata */
+    long conn = __atomic_load_n(&(client->conn), __ATOMIC_RELAXED);
+    long clientFd = CONN_FD(conn);
+
     LOG_INFO("%s (%ld) -> %s (%ld): %s",
       pkt->message.hdr.sender,
       pkt->fd,
       key,
-      client->fd,
+      clientFd,
       pkt->message.data.buf);
 
-    message_t *msg = calloc(1, sizeof(message_t));
-    memcpy(msg, &(pkt->message), sizeof(message_t));
-    msg->data.buf = calloc(msg->data.hdr.len, sizeof(char));
-    HANDLE_NULL(msg->data.buf, "calloc");
-
-    memcpy(msg->data.buf, pkt->message.data.buf, msg->data.hdr.len);
+    /* Il messaggio viene copiato una sola volta, per il primo destinatario,
+       e la copia viene condivisa da tutte le cronologie e le code di uscita */
+    if(pkt->shared == NULL) {
+      pkt->shared = cmessage_create(&(pkt->message));
+      HANDLE_NULL(pkt->shared, "cmessage_create");
+    }
 
-    message_t *oldMsg = NULL;
+    cmessage_t *oldMsg = NULL;
 
     /* Inserisco il messaggio nella cronologia */
-    int ret = ccircbuf_insert(client->message_buffer, msg, (void*)&oldMsg);
+    int ret = ccircbuf_insert(client->message_buffer, cmessage_ref(pkt->shared), (void*)&oldMsg);
     HANDLE_FATAL(ret, "ccircbuf_insert");
 
-    if(oldMsg != NULL) {
-      free(oldMsg->data.buf);
-      free(oldMsg);
-    }
+    cmessage_unref(oldMsg);
 
-    if(client->fd > 0) {
+    op_t op = pkt->message.hdr.op;
+    if(clientFd > 0) {
       /* Il client è connesso, gli invio il messaggio */
-      message_t newMsg;
-      memcpy(&newMsg, &(pkt->message), sizeof(message_t));
-
-      if(newMsg.hdr.op == POSTTXT_OP || newMsg.hdr.op == POSTTXTALL_OP) {
-        newMsg.hdr.op = TXT_MESSAGE;
-      } else {
-        newMsg.hdr.op = FILE_MESSAGE;
+      op_t newOp = FILE_MESSAGE;
+      if(op == POSTTXT_OP || op == POSTTXTALL_OP) {
+        newOp = TXT_MESSAGE;
       }
 
-      ret = send_handle_disconnect(client->fd, &newMsg, pkt->pl, client);
-      HANDLE_FATAL(ret, "send_handle_disconnect");
+      ret = send_shared(conn, newOp, pkt->shared, pkt->pl);
+      HANDLE_FATAL(ret, "send_shared");
 
       /* Aggiorno le statistiche */
       MUTEX_GUARD(pkt->pl->stats_mtx, {
-        if(msg->hdr.op == POSTTXT_OP) {
+        if(op == POSTTXT_OP) {
           if(ret == 0) {
             pkt->pl->chatty_stats.nnotdelivered++;
           } else {
@@ -445,7 +576,7 @@ static void route_message_to_client(const char *key, void *value, void *ud) {
 
     } else {
       MUTEX_GUARD(pkt->pl->stats_mtx, {
-        if(msg->hdr.op == POSTTXT_OP)
+        if(op == POSTTXT_OP)
           pkt->pl->chatty_stats.nnotdelivered++;
         else
           pkt->pl->chatty_stats.nfilenotdelivered++;
@@ -459,75 +590,162 @@ static void route_message_to_client(const char *key, void *value, void *ud) {
       memset(&ack, 0, sizeof(message_hdr_t));
       ack.op = OP_OK;
 
-      ret = send_header_handle_disconnect(pkt->fd, &ack, pkt->pl, client);
-      HANDLE_FATAL(ret, "send_header_handle_disconnect");
+      ret = send_header(pkt->fd, &ack, pkt->pl);
+      HANDLE_FATAL(ret, "send_header");
       *(pkt->is_connected) |= ret;
     }
   }
 }
 
 /**
- * \brief Instrada un messaggio verso un gruppo
+ * \brief Blocco di destinatari di un messaggio, consegnato da un thread del pool
+ */
+typedef struct {
+  cmessage_t *shared; ///< Il messaggio da consegnare
+  int n; ///< Numero di destinatari
+  cintern_id_t users[FANOUT_BATCH]; ///< Identificatori dei destinatari
+} fanout_batch_t;
+
+/**
+ * \brief Instrada un messaggio verso un client di un blocco di destinatari
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
+ * Il mittente ha già ricevuto l'ack: i destinatari che nel frattempo
+ * sono stati deregistrati vengono ignorati.
+ * 
+ * \param id L'identificatore dell'utente verso cui instradare il messaggio
+ * \param key Il nome utente del client verso cui instradare il messaggio
+ * \param value Puntatore al descrittore del client, NULL se non esiste
+ * \param ud Puntatore al pacchetto da instradare
+ */
+static void route_batch_cb(cintern_id_t id, const char *key, void *value, void *ud) {
+  if(value == NULL) return;
+
+  route_message_to_client(id, key, value, ud);
+}
+
+/**
+ * \brief Consegna un messaggio ai destinatari di un blocco
+ * 
+ * \param arg Il blocco da consegnare (\ref fanout_batch_t*), che viene deallocato
+ * \param pl Dati di contesto
+ */
+static void fanout_task(void *arg, payload_t *pl) {
+  fanout_batch_t *batch = (fanout_batch_t*)arg;
+  int is_connected = 1;
+
+  message_packet_t pkt;
+  memset(&pkt, 0, sizeof(message_packet_t));
+  pkt.pl = pl;
+  pkt.message = batch->shared->msg;
+  pkt.shared = batch->shared;
+  pkt.fd = -1;
+  pkt.broadcast = 1;
+  pkt.is_connected = &is_connected;
+
+  for(int i = 0; i < batch->n; i++) {
+    int ret = cintern_get(pl->users, batch->users[i], route_batch_cb, &pkt);
+    HANDLE_FATAL(ret, "cintern_get");
+  }
+
+  cmessage_unref(batch->shared);
+  cslab_free(batch);
+}
+
+/**
+ * \brief Instrada un messaggio verso più utenti
+ * 
+ * Se i destinatari sono più di \ref FANOUT_BATCH, vengono suddivisi in
+ * blocchi affidati ai thread del pool, e la funzione termina appena i
+ * blocchi sono stati accodati. Altrimenti il messaggio viene consegnato
+ * subito dal thread chiamante. I destinatari che nel frattempo sono stati
+ * deregistrati vengono ignorati.
+ * 
+ * \param pkt Il pacchetto da instradare, con \ref message_packet_t.broadcast impostato
+ * \param users Gli identificatori dei destinatari
+ * \param n Il numero di destinatari
+ */
+static void fanout_message(message_packet_t *pkt, const cintern_id_t *users, int n) {
+  if(n <= FANOUT_BATCH) {
+    for(int i = 0; i < n; i++) {
+      int ret = cintern_get(pkt->pl->users, users[i], route_batch_cb, pkt);
+      HANDLE_FATAL(ret, "cintern_get");
+    }
+    return;
+  }
+
+  if(pkt->shared == NULL) {
+    pkt->shared = cmessage_create(&(pkt->message));
+    HANDLE_NULL(pkt->shared, "cmessage_create");
+  }
+
+  for(int i = 0; i < n; i += FANOUT_BATCH) {
+    fanout_batch_t *batch = cslab_alloc(sizeof(fanout_batch_t));
+    HANDLE_NULL(batch, "cslab_alloc");
+    batch->shared = cmessage_ref(pkt->shared);
+    batch->n = 0;
+
+    for(int j = i; j < n && j < i + FANOUT_BATCH; j++) {
+      batch->users[batch->n++] = users[j];
+    }
+
+    dispatch_task(pkt->pl, fanout_task, batch);
+  }
+}
+
+/**
+ * \brief Instrada un messaggio verso i membri di un gruppo
+ * 
+ * \param ids Gli identificatori dei membri del gruppo
+ * \param n Il numero di membri
+ * \param ud Puntatore al pacchetto da instradare
+ */
+static void route_group_members_cb(const cintern_id_t *ids, size_t n, void *ud) {
+  fanout_message((message_packet_t*)ud, ids, (int)n);
+}
+
+/**
+ * \brief Instrada un messaggio verso un gruppo
  * 
  * \param key Il nome del gruppo verso cui instradare il messaggio
- * \param value Puntatore alla lista degli utenti verso cui instradare
+ * \param value Puntatore all'insieme degli utenti verso cui instradare
  * \param ud Puntatore al pacchetto da instradare
  */
 static void route_message_to_group(const char *key, void *value, void *ud) {
-  cstrlist_t *list = (cstrlist_t*)value;
+  cidset_t *group = (cidset_t*)value;
   message_packet_t *pkt = (message_packet_t*)ud;
 
-  if(list == NULL) {
+  if(group == NULL) {
     /* Il gruppo non esiste, ignoriamo.
        L'invio verrà gestito da route_message_to_client */
     return;
   }
 
   pkt->broadcast = 1;
-  char **users;
-
-  /* Estraggo i nickname di tutti gli utenti registrati al gruppo */
-  int ret, num = cstrlist_get_values(list, &users);
-  HANDLE_FATAL(num, "cstrlist_get_values");
-
-  /* Controllo che il mittente faccia parte della lista degli utenti
-     registrati al gruppo */
-  int is_in_group = 0;
-  for(int i = 0; i < num; i++) {
-    if(strncmp(pkt->message.hdr.sender, users[i], MAX_NAME_LENGTH) == 0) {
-      is_in_group = 1;
-      break;
-    }
-  }
+
+  /* Controllo che il mittente faccia parte degli utenti registrati al
+     gruppo */
+  int ret, is_in_group = cidset_contains(group, cintern_find(pkt->pl->users, pkt->message.hdr.sender));
+  HANDLE_FATAL(is_in_group, "cidset_contains");
 
   if(is_in_group) {
-    for(int i = 0; i < num; i++) {
-      ret = chash_get(pkt->pl->registered_clients, users[i], route_message_to_client, pkt);
-      HANDLE_FATAL(ret, "chash_get");
-      free(users[i]);
-    }
+    /* L'elenco dei membri viene letto senza lock e senza copiarlo: gli
+       invii allo stesso gruppo procedono in parallelo */
+    ret = cidset_get_members(group, route_group_members_cb, pkt);
+    HANDLE_FATAL(ret, "cidset_get_members");
 
     message_hdr_t ack;
     memset(&ack, 0, sizeof(message_hdr_t));
     ack.op = OP_OK;
 
-    ret = send_header_handle_disconnect(pkt->fd, &ack, pkt->pl, NULL);
-    HANDLE_FATAL(ret, "send_header_handle_disconnect");
+    ret = send_header(pkt->fd, &ack, pkt->pl);
+    HANDLE_FATAL(ret, "send_header");
     *(pkt->is_connected) |= ret;
   } else {
-    for(int i = 0; i < num; i++) {
-      free(users[i]);
-    }
-
     ret = send_error_message(pkt->fd, OP_NICK_UNKNOWN, pkt->pl,
-                             pkt->message.hdr.sender, "Client non registrato al gruppo", NULL);
+                             pkt->message.hdr.sender, "Client non registrato al gruppo");
     HANDLE_FATAL(ret, "send_error_message");
     *(pkt->is_connected) |= ret;
   }
-  free(users);
   pkt->sent = 1;
 }
 
@@ -543,26 +761,18 @@ static void route_message_to_group(const char *key, void *value, void *ud) {
 static void handle_post_txt(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == POSTTXT_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  char nick[MAX_NAME_LENGTH + 1];
+  if(!get_connected_nick(fd, pl, nick)) {
     /* Un client non connesso ha tentato di inviare un messaggio */
     LOG_WARN("Il client %ld non connesso ha tentato di inviare un messaggio", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
   if(msg->data.hdr.len > pl->cfg->maxMsgSize) {
     /* Il messaggio è troppo lungo */
-    LOG_WARN("'%s' ha tentato di inviare un messaggio troppo lungo", pl->connected_clients[clientIdx].nick);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "Messaggio testuale troppo lungo", NULL);
-    });
+    LOG_WARN("'%s' ha tentato di inviare un messaggio troppo lungo", nick);
+    *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "Messaggio testuale troppo lungo");
     return;
   }
 
@@ -573,16 +783,44 @@ static void handle_post_txt(long fd, message_t *msg, payload_t *pl, int *is_conn
   pkt.fd = fd;
   pkt.is_connected = is_connected;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    /* Prima tentiamo di inviare il messaggio ad un gruppo */
-    int ret = chash_get(pl->groups, msg->data.hdr.receiver, route_message_to_group, &pkt);
-    HANDLE_FATAL(ret, "chash_get");
+  /* Prima tentiamo di inviare il messaggio ad un gruppo */
+  int ret = chash_get(pl->groups, msg->data.hdr.receiver, route_message_to_group, &pkt);
+  HANDLE_FATAL(ret, "chash_get");
 
-    /* Se il gruppo non esiste, tentiamo di inviare il messaggio ad un utente registrato */
-    ret = chash_get(pl->registered_clients, msg->data.hdr.receiver, route_message_to_client, &pkt);
-    HANDLE_FATAL(ret, "chash_get");
-  });
-  
+  /* Se il gruppo non esiste, tentiamo di inviare il messaggio ad un utente registrato */
+  ret = cintern_lookup(pl->users, msg->data.hdr.receiver, route_message_to_client, &pkt);
+  HANDLE_FATAL(ret, "cintern_lookup");
+
+  cmessage_unref(pkt.shared);
+}
+
+/**
+ * \brief Elenco di utenti
+ */
+struct user_list {
+  cintern_id_t *ids; ///< Gli identificatori degli utenti
+  int n; ///< Numero di utenti
+  int cap; ///< Capienza di \ref ids
+};
+
+/**
+ * \brief Aggiunge un utente registrato ad un elenco
+ * 
+ * \param id L'identificatore dell'utente
+ * \param key Il nickname dell'utente
+ * \param value Puntatore al descrittore dell'utente
+ * \param ud Puntatore all'elenco (\ref user_list)
+ */
+static void collect_user_cb(cintern_id_t id, const char *key, void *value, void *ud) {
+  struct user_list *list = (struct user_list*)ud;
+
+  if(list->n == list->cap) {
+    list->cap = list->cap == 0 ? FANOUT_BATCH : list->cap * 2;
+    list->ids = realloc(list->ids, list->cap * sizeof(cintern_id_t));
+    HANDLE_NULL(list->ids, "realloc");
+  }
+
+  list->ids[list->n++] = id;
 }
 
 /**
@@ -597,27 +835,19 @@ static void handle_post_txt(long fd, message_t *msg, payload_t *pl, int *is_conn
 static void handle_post_txt_all(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == POSTTXTALL_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  char nick[MAX_NAME_LENGTH + 1];
+  if(!get_connected_nick(fd, pl, nick)) {
     /* Un client non connesso ha tentato di inviare un messaggio */
     LOG_WARN("Il client %ld non connesso ha tentato di inviare un messaggio broadcast", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
   if(msg->data.hdr.len > pl->cfg->maxMsgSize) {
     /* Il messaggio è troppo lungo */
     LOG_WARN("'%s' ha tentato di inviare un messaggio broadcast troppo lungo",
-      pl->connected_clients[clientIdx].nick);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "Messaggio testuale troppo lungo", NULL);
-    });
+      nick);
+    *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "Messaggio testuale troppo lungo");
     return;
   }
 
@@ -630,20 +860,24 @@ static void handle_post_txt_all(long fd, message_t *msg, payload_t *pl, int *is_
                         per ogni client che riceve il messaggio */
   pkt.is_connected = is_connected;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    int ret = chash_get_all(pl->registered_clients, route_message_to_client, &pkt);
-    HANDLE_FATAL(ret, "chash_get_all");
-  });
+  /* La scansione non blocca la tabella, e la consegna ai destinatari
+     raccolti avviene in parallelo */
+  struct user_list users;
+  memset(&users, 0, sizeof(users));
+  int ret = cintern_get_all(pl->users, collect_user_cb, &users);
+  HANDLE_FATAL(ret, "cintern_get_all");
+
+  fanout_message(&pkt, users.ids, users.n);
+  free(users.ids);
+  cmessage_unref(pkt.shared);
 
   message_hdr_t ack;
   memset(&ack, 0, sizeof(message_hdr_t));
   ack.op = OP_OK;
 
   int res;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    res = send_header_handle_disconnect(fd, &ack, pl, 0);
-  });
-  HANDLE_FATAL(res, "send_header_handle_disconnect");
+  res = send_header(fd, &ack, pl);
+  HANDLE_FATAL(res, "send_header");
   *is_connected |= res;
 }
 
@@ -684,38 +918,30 @@ static const char *strip_file_name(const char * file_path, size_t *len) {
 static void handle_post_file(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == POSTFILE_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  char nick[MAX_NAME_LENGTH + 1];
+  if(!get_connected_nick(fd, pl, nick)) {
     /* Un client non connesso ha tentato di inviare un file */
     LOG_WARN("Il client %ld non connesso ha tentato di inviare un file", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
   message_data_t file_data;
   memset(&file_data, 0, sizeof(message_data_t));
-  int ret = readData(fd, &file_data);
+  int ret = msgbuf_read_data(fd, &(pl->conns[fd].in), &file_data);
   if(ret == 0 || HAS_DISCONNECTED(ret)) {
     disconnect_client(fd, pl, NULL);
     *is_connected = 0; 
     return;
   }
-  HANDLE_FATAL(ret, "readData");
+  HANDLE_FATAL(ret, "msgbuf_read_data");
 
   if(file_data.hdr.len > pl->cfg->maxFileSize * 1000) {
     /* Il file è troppo lungo */
     LOG_WARN("'%s' ha tentato di inviare un file troppo lungo",
-      pl->connected_clients[clientIdx].nick);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "File troppo lungo", NULL);
-    });
-    free(file_data.buf);
+      nick);
+    *is_connected |= send_error_message(fd, OP_MSG_TOOLONG, pl, NULL, "File troppo lungo");
+    cslab_free(file_data.buf);
     return;
   }
 
@@ -723,7 +949,8 @@ static void handle_post_file(long fd, message_t *msg, payload_t *pl, int *is_con
   const char *file_name = strip_file_name(msg->data.buf, &file_name_len);
 
   /* Crea il path completo del file nella directory specificata nelle impostazioni */
-  char *file_path = calloc(file_name_len + dir_path_len + 2, sizeof(char));
+  char *file_path = carena_calloc(request_arena(), file_name_len + dir_path_len + 2, sizeof(char));
+  HANDLE_NULL(file_path, "carena_calloc");
   strncpy(file_path, pl->cfg->dirName, dir_path_len);
   strncat(file_path, "/", 1);
   strncat(file_path, file_name, file_name_len);
@@ -736,8 +963,7 @@ static void handle_post_file(long fd, message_t *msg, payload_t *pl, int *is_con
   fclose(file);
   file = NULL;
 
-  free(file_path);
-  free(file_data.buf);
+  cslab_free(file_data.buf);
 
   message_packet_t pkt;
   memset(&pkt, 0, sizeof(message_packet_t));
@@ -749,15 +975,15 @@ static void handle_post_file(long fd, message_t *msg, payload_t *pl, int *is_con
   pkt.message.data.buf = (char*)file_name;
   pkt.message.data.hdr.len = file_name_len + 1;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    /* Prima tentiamo di inviare il messaggio ad un gruppo */
-    ret = chash_get(pl->groups, msg->data.hdr.receiver, route_message_to_group, &pkt);
-    HANDLE_FATAL(ret, "chash_get");
+  /* Prima tentiamo di inviare il messaggio ad un gruppo */
+  ret = chash_get(pl->groups, msg->data.hdr.receiver, route_message_to_group, &pkt);
+  HANDLE_FATAL(ret, "chash_get");
 
-    /* Se non esiste il gruppo, tentiamo l'invio ad un utente */
-    ret = chash_get(pl->registered_clients, msg->data.hdr.receiver, route_message_to_client, &pkt);
-    HANDLE_FATAL(ret, "chash_get");
-  });
+  /* Se non esiste il gruppo, tentiamo l'invio ad un utente */
+  ret = cintern_lookup(pl->users, msg->data.hdr.receiver, route_message_to_client, &pkt);
+  HANDLE_FATAL(ret, "cintern_lookup");
+
+  cmessage_unref(pkt.shared);
 }
 
 /**
@@ -772,17 +998,11 @@ static void handle_post_file(long fd, message_t *msg, payload_t *pl, int *is_con
 static void handle_get_file(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == GETFILE_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  char nick[MAX_NAME_LENGTH + 1];
+  if(!get_connected_nick(fd, pl, nick)) {
     /* Un client non connesso ha tentato di inviare un file */
     LOG_WARN("Il client %ld non connesso ha tentato di ricevere un file", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
@@ -790,19 +1010,17 @@ static void handle_get_file(long fd, message_t *msg, payload_t *pl, int *is_conn
   size_t dir_path_len = strlen(pl->cfg->dirName);
 
   /* Crea il path completo del file nella directory specificata nelle impostazioni */
-  char *file_path = calloc(file_name_len + dir_path_len + 2, sizeof(char));
+  char *file_path = carena_calloc(request_arena(), file_name_len + dir_path_len + 2, sizeof(char));
+  HANDLE_NULL(file_path, "carena_calloc");
   strncpy(file_path, pl->cfg->dirName, dir_path_len);
   strncat(file_path, "/", 1);
   strncat(file_path, msg->data.buf, file_name_len);
 
   /* Scrive il file nella directory */
   FILE *file = fopen(file_path, "wb");
-  free(file_path);
   if(file == NULL) {
-    LOG_WARN("'%s' ha richiesto un file non disponibile", pl->connected_clients[clientIdx].nick);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Impossibile accedere al file richiesto", NULL);
-    });
+    LOG_WARN("'%s' ha richiesto un file non disponibile", nick);
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Impossibile accedere al file richiesto");
     return;
   }
 
@@ -813,14 +1031,14 @@ static void handle_get_file(long fd, message_t *msg, payload_t *pl, int *is_conn
   fseek(file, 0, SEEK_SET);
 
   /* Alloco il buffer di risposta */
-  char *data = calloc(fsize, sizeof(char));
-  HANDLE_NULL(data, "calloc");
+  char *data = carena_alloc(request_arena(), fsize);
+  HANDLE_NULL(data, "carena_alloc");
   
   fread(data, fsize, 1, file);
   fclose(file);
   file = NULL;
 
-  LOG_INFO("'%s' ha richiesto un file", pl->connected_clients[clientIdx].nick);
+  LOG_INFO("'%s' ha richiesto un file", nick);
 
   message_t answer;
   memset(&answer, 0, sizeof(message_t));
@@ -828,23 +1046,27 @@ static void handle_get_file(long fd, message_t *msg, payload_t *pl, int *is_conn
   answer.data.hdr.len = fsize;
   answer.hdr.op = OP_OK;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    *is_connected |= send_handle_disconnect(fd, &answer, pl, NULL);
-  });
-  free(data);
+  *is_connected |= send_message(fd, &answer, pl);
 }
 
 /**
- * \brief Viene chiamata da \ref handle_get_prev_msgs
+ * \brief Acquisisce un riferimento ad un messaggio della cronologia
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
+ * \param elem Il messaggio (\ref cmessage_t*)
+ */
+static void ref_history_msg(void *elem) {
+  cmessage_ref((cmessage_t*)elem);
+}
+
+/**
+ * \brief Viene chiamata da \ref handle_get_prev_msgs
  * 
+ * \param id Identificatore dell'utente di cui ottenere la cronologia
  * \param key Nickname dell'utente di cui ottenere la cronologia
  * \param value Utente di cui ottenere la cronologia, NULL se non esistente
  * \param ud Dati di contesto
  */
-static void handle_get_prev_msgs_cb(const char *key, void *value, void *ud) {
+static void handle_get_prev_msgs_cb(cintern_id_t id, const char *key, void *value, void *ud) {
   assert(ud != NULL);
   struct callback_data *data = (struct callback_data*)ud;
 
@@ -853,17 +1075,24 @@ static void handle_get_prev_msgs_cb(const char *key, void *value, void *ud) {
     INCREASE_ERRORS(data->pl);
     LOG_WARN("E' stata richiesta la cronologia dell'utente '%s' non esistente", key);
 
-    *(data->is_connected) |= send_error_message(data->fd, OP_NICK_UNKNOWN, data->pl, key, "Nickname non esistente", NULL);
+    *(data->is_connected) |= send_error_message(data->fd, OP_NICK_UNKNOWN, data->pl, key, "Nickname non esistente");
   } else {
     LOG_INFO("'%s' ha richiesto la cronologia", key);
 
     client_descriptor_t *cd = (client_descriptor_t *)value;
 
+    /* Viene acquisito un riferimento ai messaggi, che altrimenti potrebbero
+       essere deallocati da un invio concorrente che li rimuove dalla
+       cronologia */
     void **elems;
-    int numMsgs = ccircbuf_get_elems(cd->message_buffer, &elems);
+    int numMsgs = ccircbuf_get_elems(cd->message_buffer, &elems, ref_history_msg);
     HANDLE_FATAL(numMsgs, "ccircbuf_get_elems");
 
-    size_t *buf = calloc(1, sizeof(size_t));
+    /* Il contatore e i vettori del batch vivono solo per la durata della
+       richiesta */
+    carena_t *arena = request_arena();
+    size_t *buf = carena_alloc(arena, sizeof(size_t));
+    HANDLE_NULL(buf, "carena_alloc");
     *buf = numMsgs;
 
     message_t ack;
@@ -872,24 +1101,27 @@ static void handle_get_prev_msgs_cb(const char *key, void *value, void *ud) {
     ack.data.buf = (char*)buf;
     ack.data.hdr.len = sizeof(size_t);
 
-    int ret = send_handle_disconnect(data->fd, &ack, data->pl, cd);
-    free(buf);
+    /* L'ack e tutti i messaggi della cronologia vengono inviati insieme.
+       I messaggi della cronologia vengono condivisi, non copiati */
+    message_t **batch = carena_alloc(arena, (numMsgs + 1) * sizeof(message_t*));
+    cmessage_t **shared = carena_calloc(arena, numMsgs + 1, sizeof(cmessage_t*));
+    HANDLE_NULL(batch, "carena_alloc");
+    HANDLE_NULL(shared, "carena_calloc");
+    batch[0] = &ack;
+    for(int i = 0; i < numMsgs; i++) {
+      shared[i + 1] = (cmessage_t*)elems[i];
+      batch[i + 1] = &(shared[i + 1]->msg);
+    }
+
+    int ret = send_batch(data->fd, batch, shared, numMsgs + 1, data->pl);
+    HANDLE_FATAL(ret, "send_batch");
     if(ret == 0) {
       *(data->is_connected) = 0;
-      return;
     }
 
-    int connected = 1;
-    
     for(int i = 0; i < numMsgs; i++) {
-      message_t *elem = (message_t*)elems[i];
-
-      if(connected) {
-        connected = send_handle_disconnect(data->fd, elem, data->pl, cd);
-      }
+      cmessage_unref(elems[i]);
     }
-    *(data->is_connected) |= connected;
-
     free(elems);
   }
 }
@@ -906,17 +1138,11 @@ static void handle_get_prev_msgs_cb(const char *key, void *value, void *ud) {
 static void handle_get_prev_msgs(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == GETPREVMSGS_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  char nick[MAX_NAME_LENGTH + 1];
+  if(!get_connected_nick(fd, pl, nick)) {
     /* Un client non connesso ha tentato di richiedere la cronologia */
     LOG_WARN("Il client %ld non connesso ha richiesto la cronologia di un utente", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
@@ -925,10 +1151,8 @@ static void handle_get_prev_msgs(long fd, message_t *msg, payload_t *pl, int *is
   data.pl = pl;
   data.is_connected = is_connected;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    int ret = chash_get(pl->registered_clients, msg->hdr.sender, handle_get_prev_msgs_cb, &data);
-    HANDLE_FATAL(ret, "chash_get");
-  });
+  int ret = cintern_lookup(pl->users, msg->hdr.sender, handle_get_prev_msgs_cb, &data);
+  HANDLE_FATAL(ret, "cintern_lookup");
 }
 
 /**
@@ -944,31 +1168,85 @@ static void handle_usr_list(long fd, message_t *msg, payload_t *pl, int *is_conn
   assert(msg->hdr.op == USRLIST_OP);
 
   LOG_INFO("Il client '%ld' ha richiesto la lista degli utenti connessi", fd);
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    *is_connected = send_user_list(fd, pl, NULL);
+  *is_connected = send_user_list(fd, pl);
+}
+
+/**
+ * \brief Aggiunge un utente ad un gruppo, aggiornando l'indice dei gruppi
+ *        dell'utente
+ * 
+ * \param cd Il descrittore dell'utente
+ * \param user L'identificatore dell'utente
+ * \param group Il gruppo
+ * \return int 0 in caso di successo, -1 e errno impostato a EALREADY se
+ *             l'utente faceva già parte del gruppo o a ENOENT se è stato
+ *             deregistrato
+ */
+static int join_group(client_descriptor_t *cd, cintern_id_t user, cidset_t *group) {
+  int res = 0;
+  MUTEX_GUARD(cd->groups_mtx, {
+    if(cd->unregistered) {
+      errno = ENOENT;
+      res = -1;
+    } else if((res = cidset_insert(group, user)) == 0) {
+      cd->id = user;
+      if(cd->ngroups == cd->groups_cap) {
+        cd->groups_cap = cd->groups_cap == 0 ? 4 : cd->groups_cap * 2;
+        cd->groups = realloc(cd->groups, cd->groups_cap * sizeof(cidset_t*));
+        HANDLE_NULL(cd->groups, "realloc");
+      }
+      cd->groups[cd->ngroups++] = group;
+    } else if(errno != EALREADY) {
+      HANDLE_FATAL(res, "cidset_insert");
+    }
   });
+  return res;
 }
 
 /**
- * \brief Viene chiamata da \ref handle_unregister nel momento in cui un utente
- *        si deregistra per eliminarlo da tutti i gruppi
+ * \brief Rimuove un utente da un gruppo, aggiornando l'indice dei gruppi
+ *        dell'utente
  * 
- * \param key Il nome del gruppo
- * \param value Il gruppo contenente una lista di utenti
- * \param ub Il nickname dell'utente deregistrato
+ * \param cd Il descrittore dell'utente
+ * \param user L'identificatore dell'utente
+ * \param group Il gruppo
+ * \return int 0 in caso di successo, -1 e errno impostato a ENOENT se
+ *             l'utente non faceva parte del gruppo
  */
-static void handle_unregister_cb(const char *key, void *value, void *ub) {
-  cstrlist_t *group = (cstrlist_t*)value;
-  char *name = (char*)ub;
-
-  int ret = cstrlist_remove(group, name);
-  if(ret != 0) {
-    if(errno == ENOENT) {
-      /* L'utente che si è deregistrato non era in questo gruppo, ignoriamo */
-    } else {
-      HANDLE_FATAL(ret, "cstrlist_remove");
+static int leave_group(client_descriptor_t *cd, cintern_id_t user, cidset_t *group) {
+  int res = 0;
+  MUTEX_GUARD(cd->groups_mtx, {
+    if((res = cidset_remove(group, user)) == 0) {
+      for(int i = 0; i < cd->ngroups; i++) {
+        if(cd->groups[i] == group) {
+          cd->groups[i] = cd->groups[--cd->ngroups];
+          break;
+        }
+      }
+    } else if(errno != ENOENT) {
+      HANDLE_FATAL(res, "cidset_remove");
     }
-  }
+  });
+  return res;
+}
+
+/**
+ * \brief Rimuove un utente deregistrato da tutti i gruppi di cui faceva parte
+ * 
+ * Vengono visitati solo i gruppi dell'utente, senza scorrere la tabella dei
+ * gruppi. Dopo la chiamata l'utente non può più essere aggiunto a gruppi.
+ * 
+ * \param cd Il descrittore dell'utente
+ */
+static void leave_all_groups(client_descriptor_t *cd) {
+  MUTEX_GUARD(cd->groups_mtx, {
+    cd->unregistered = 1;
+    for(int i = 0; i < cd->ngroups; i++) {
+      int ret = cidset_remove(cd->groups[i], cd->id);
+      HANDLE_FATAL(ret, "cidset_remove");
+    }
+    cd->ngroups = 0;
+  });
 }
 
 /**
@@ -985,35 +1263,33 @@ static void handle_unregister(long fd, message_t *msg, payload_t *pl, int *is_co
 
   client_descriptor_t *deletedUser;
 
-  HANDLE_FATAL(chash_set(pl->registered_clients, msg->data.hdr.receiver, NULL, (void*)(&deletedUser)), "chash_set");
+  HANDLE_FATAL(cintern_remove(pl->users, msg->data.hdr.receiver, (void*)(&deletedUser)), "cintern_remove");
   if(deletedUser == NULL) {
     /* Tentativo di deregistrazione di un nickname non registrato */
     INCREASE_ERRORS(pl);
     LOG_WARN("Tentativo di deregistrazione di '%s' non esistente", msg->data.hdr.receiver);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_NICK_UNKNOWN, pl, msg->hdr.sender, "Nickname non esistente", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_NICK_UNKNOWN, pl, msg->hdr.sender, "Nickname non esistente");
   } else {
     LOG_INFO("Deregistrazione di '%s'", msg->data.hdr.receiver);
 
     disconnect_client(fd, pl, deletedUser);
-    free_client_descriptor(deletedUser);
 
     /* Elimina l'utente deregistrato da tutti i gruppi */
-    int res = chash_get_all(pl->groups, handle_unregister_cb, msg->data.hdr.receiver);
-    HANDLE_FATAL(res, "chash_get_all");
+    leave_all_groups(deletedUser);
+
+    /* Il descrittore può essere ancora in uso da letture concorrenti della
+       tabella, e viene deallocato quando sono tutte terminate */
+    HANDLE_FATAL(cebr_retire(deletedUser, free_client_descriptor), "cebr_retire");
 
     message_t ack;
     memset(&ack, 0, sizeof(message_t));
     strncpy(ack.data.hdr.receiver, msg->hdr.sender, MAX_NAME_LENGTH);
     ack.hdr.op = OP_OK;
 
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      res = send_handle_disconnect(fd, &ack, pl, 0);
-      HANDLE_FATAL(res, "send_handle_disconnect");
-    });
-    close(fd);
+    int res = send_message(fd, &ack, pl);
+    HANDLE_FATAL(res, "send_message");
 
+    /* Il descrittore verrà chiuso al termine della richiesta */
     *is_connected = 0;
 
     MUTEX_GUARD(pl->stats_mtx, {
@@ -1035,185 +1311,244 @@ static void handle_disconnect(long fd, message_t *msg, payload_t *pl, int *is_co
   assert(msg->hdr.op == DISCONNECT_OP);
 
   disconnect_client(fd, pl, NULL);
-  close(fd);
+  /* Il descrittore verrà chiuso al termine della richiesta */
   *is_connected = 0;
 }
 
 /**
- * \brief Gestisce una richiesta di creazione di un gruppo
+ * \brief Dati di contesto delle operazioni sui gruppi
+ */
+struct group_request {
+  struct callback_data cb; ///< Dati comuni alle callback
+  message_t *msg; ///< Il messaggio ricevuto
+  cintern_id_t user; ///< L'utente che ha richiesto l'operazione
+  client_descriptor_t *cd; ///< Il descrittore dell'utente
+  chash_get_callback *op; ///< L'operazione da eseguire sul gruppo
+};
+
+/**
+ * \brief Invia una conferma al client che ha richiesto un'operazione sui gruppi
  * 
- * \param fd Il descrittore del client che ha richiesto l'operazione
- * \param msg Il messaggio ricevuto
- * \param pl Dati di contesto
- * \param is_connected Viene impostato a 0 se \p fd si disconnette durante
- *                     l'operazione
+ * \param req Dati di contesto
  */
-static void handle_create_group(long fd, message_t *msg, payload_t *pl, int *is_connected) {
-  assert(msg->hdr.op == CREATEGROUP_OP);
+static void send_group_ack(struct group_request *req) {
+  message_hdr_t ack;
+  memset(&ack, 0, sizeof(message_hdr_t));
+  ack.op = OP_OK;
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
+  int res = send_header(req->cb.fd, &ack, req->cb.pl);
+  HANDLE_FATAL(res, "send_header");
+  *(req->cb.is_connected) |= res;
+}
 
-  if(clientIdx == -1) {
-    /* Un client non connesso ha tentato di creare un gruppo */
-    LOG_WARN("Il client %ld non connesso ha tentato di creare un gruppo", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+/**
+ * \brief Viene chiamata da \ref handle_create_group con il descrittore del
+ *        creatore del gruppo
+ * 
+ * \param id L'identificatore del creatore
+ * \param key Il nickname del creatore
+ * \param value Il descrittore del creatore, NULL se è stato deregistrato
+ * \param ud Dati di contesto (tipo: \ref group_request*)
+ */
+static void create_group_cb(cintern_id_t id, const char *key, void *value, void *ud) {
+  struct group_request *req = (struct group_request*)ud;
+  client_descriptor_t *cd = (client_descriptor_t*)value;
+  int fd = req->cb.fd;
+
+  if(cd == NULL) {
+    LOG_WARN("Il client %d deregistrato ha tentato di creare un gruppo", fd);
+    *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Client non registrato");
     return;
   }
 
-  cstrlist_t *list = cstrlist_init();
+  cidset_t *list = cidset_init(0);
+  HANDLE_NULL(list, "cidset_init");
 
   /* Controllo che non esistano altri gruppi con lo stesso nome */
-  int res = chash_set_if_empty(pl->groups, msg->data.hdr.receiver, list);
+  int res = chash_set_if_empty(req->cb.pl->groups, req->msg->data.hdr.receiver, list);
   if(res == 0) {
-    LOG_INFO("Gruppo %s creato da %s (%ld)", msg->data.hdr.receiver, "", fd);
-
-    message_hdr_t ack;
-    memset(&ack, 0, sizeof(message_hdr_t));
-    ack.op = OP_OK;
+    LOG_INFO("Gruppo %s creato da %s (%d)", req->msg->data.hdr.receiver, key, fd);
 
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      /* Aggiungo il creatore al gruppo */
-      cstrlist_insert(list, pl->connected_clients[clientIdx].nick);
+    /* Aggiungo il creatore al gruppo. Se si è deregistrato nel frattempo il
+       gruppo resta vuoto */
+    join_group(cd, id, list);
 
-      res = send_header_handle_disconnect(fd, &ack, pl, 0);
-    });
-    HANDLE_FATAL(res, "send_header_handle_disconnect");
-    *is_connected |= res;
+    send_group_ack(req);
   } else if(res == 1) {
-    LOG_WARN("Gruppo %s di %s (%ld) già esistente", msg->data.hdr.receiver, msg->hdr.sender, fd);
-    cstrlist_deinit(list);
+    LOG_WARN("Gruppo %s di %s (%d) già esistente", req->msg->data.hdr.receiver, key, fd);
+    HANDLE_FATAL(cidset_deinit(list), "cidset_deinit");
 
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Gruppo già esistente", NULL);
-    });
+    *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Gruppo già esistente");
   } else {
     HANDLE_FATAL(res, "chash_set_if_empty");
   }
 }
 
+/**
+ * \brief Gestisce una richiesta di creazione di un gruppo
+ * 
+ * \param fd Il descrittore del client che ha richiesto l'operazione
+ * \param msg Il messaggio ricevuto
+ * \param pl Dati di contesto
+ * \param is_connected Viene impostato a 0 se \p fd si disconnette durante
+ *                     l'operazione
+ */
+static void handle_create_group(long fd, message_t *msg, payload_t *pl, int *is_connected) {
+  assert(msg->hdr.op == CREATEGROUP_OP);
+
+  cintern_id_t user = get_connected_user(fd, pl);
+  if(user == CINTERN_NONE) {
+    /* Un client non connesso ha tentato di creare un gruppo */
+    LOG_WARN("Il client %ld non connesso ha tentato di creare un gruppo", fd);
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
+    return;
+  }
+
+  struct group_request req;
+  memset(&req, 0, sizeof(struct group_request));
+  req.cb.pl = pl;
+  req.cb.fd = fd;
+  req.cb.is_connected = is_connected;
+  req.msg = msg;
+
+  int res = cintern_get(pl->users, user, create_group_cb, &req);
+  HANDLE_FATAL(res, "cintern_get");
+}
+
 /**
  * \brief Funzione chiamata da handle_add_group per eseguire l'aggiunta di un
  *        utente ad un gruppo
  * 
  * \param key Il nome del gruppo a cui è stata tentata l'aggiuna
  * \param value Il gruppo a cui aggiungere l'utente. NULL se il gruppo non esiste
- * \param ud Dati di contesto (tipo: \ref callback_data*)
+ * \param ud Dati di contesto (tipo: \ref group_request*)
  */
 static void handle_add_group_cb(const char *key, void *value, void *ud) {
-  struct callback_data *cbdata = (struct callback_data*)ud;
-  cstrlist_t *list = (cstrlist_t*)value;
+  struct group_request *req = (struct group_request*)ud;
+  cidset_t *list = (cidset_t*)value;
+  int fd = req->cb.fd;
 
   if(list == NULL) {
     /* Tentativo di aggiungere un utente ad un gruppo non esistente */
-    LOG_WARN("Il client %d ha tentato di aggiungersi ad un gruppo non esistente", cbdata->fd);
+    LOG_WARN("Il client %d ha tentato di aggiungersi ad un gruppo non esistente", fd);
 
-    *(cbdata->is_connected) |= send_error_message(cbdata->fd, OP_FAIL, cbdata->pl, NULL, "Gruppo inesistente", NULL);
-  } else {
-    int res = cstrlist_insert(list, cbdata->data);
-    if(res != 0) {
-      if(errno == EALREADY) {
-        LOG_WARN("Il client %d ha tentato di aggiungersi nuovamente ad un gruppo", cbdata->fd);
-
-        *(cbdata->is_connected) |= send_error_message(cbdata->fd, OP_FAIL, cbdata->pl, NULL, "Utente già presente nel gruppo", NULL);
-      } else {
-        HANDLE_FATAL(res, "cstrlist_insert");
-      }
+    *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Gruppo inesistente");
+  } else if(join_group(req->cd, req->user, list) != 0) {
+    if(errno == EALREADY) {
+      LOG_WARN("Il client %d ha tentato di aggiungersi nuovamente ad un gruppo", fd);
+
+      *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Utente già presente nel gruppo");
     } else {
-      message_hdr_t ack;
-      memset(&ack, 0, sizeof(message_hdr_t));
-      ack.op = OP_OK;
+      LOG_WARN("Il client %d deregistrato ha tentato di aggiungersi ad un gruppo", fd);
 
-      res = send_header_handle_disconnect(cbdata->fd, &ack, cbdata->pl, 0);
-      HANDLE_FATAL(res, "send_header_handle_disconnect");
-      *(cbdata->is_connected) |= res;
+      *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Client non registrato");
     }
+  } else {
+    send_group_ack(req);
   }
 }
 
 /**
- * \brief Gestisce una richiesta di aggiunta ad un gruppo
+ * \brief Funzione chiamata da handle_del_group per eseguire la rimozione di un
+ *        utente da un gruppo
  * 
- * \param fd Il descrittore del client che ha richiesto l'operazione
- * \param msg Il messaggio ricevuto
- * \param pl Dati di contesto
- * \param is_connected Viene impostato a 0 se \p fd si disconnette durante
- *                     l'operazione
+ * \param key Il nome del gruppo da cui è stata tentata la rimozione
+ * \param value Il gruppo da cui rimuovere l'utente. NULL se il gruppo non esiste
+ * \param ud Dati di contesto (tipo: \ref group_request*)
  */
-static void handle_add_group(long fd, message_t *msg, payload_t *pl, int *is_connected) {
-  assert(msg->hdr.op == ADDGROUP_OP);
+static void handle_del_group_cb(const char *key, void *value, void *ud) {
+  struct group_request *req = (struct group_request*)ud;
+  cidset_t *list = (cidset_t*)value;
+  int fd = req->cb.fd;
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
+  if(list == NULL) {
+    /* Tentativo di rimozione di un utente da un gruppo non esistente */
+    LOG_WARN("Il client %d ha tentato di rimuoversi da un gruppo non esistente", fd);
 
-  if(clientIdx == -1) {
-    /* Un client non connesso ha tentato di aggiungersi ad un gruppo */
-    LOG_WARN("Il client %ld non connesso ha tentato di aggiungersi ad un gruppo", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
-    return;
+    *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Gruppo inesistente");
+  } else if(leave_group(req->cd, req->user, list) != 0) {
+    LOG_WARN("Il client %d ha tentato di rimuoversi da un gruppo a cui non era iscritto", fd);
+
+    *(req->cb.is_connected) |= send_error_message(fd, OP_FAIL, req->cb.pl, NULL, "Utente non presente nel gruppo");
+  } else {
+    send_group_ack(req);
   }
+}
 
-  struct callback_data cbdata;
-  memset(&cbdata, 0, sizeof(struct callback_data));
-  cbdata.pl = pl;
-  cbdata.fd = fd;
-  cbdata.data = msg->hdr.sender;
-  cbdata.is_connected = is_connected;
+/**
+ * \brief Viene chiamata da \ref run_group_request con il descrittore
+ *        dell'utente, ed esegue l'operazione richiesta sul gruppo
+ * 
+ * \param id L'identificatore dell'utente
+ * \param key Il nickname dell'utente
+ * \param value Il descrittore dell'utente, NULL se è stato deregistrato
+ * \param ud Dati di contesto (tipo: \ref group_request*)
+ */
+static void group_request_cb(cintern_id_t id, const char *key, void *value, void *ud) {
+  struct group_request *req = (struct group_request*)ud;
 
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    int res = chash_get(pl->groups, msg->data.hdr.receiver, handle_add_group_cb, &cbdata);
-    HANDLE_FATAL(res, "chash_get");
-  });
+  if(value == NULL) {
+    LOG_WARN("Il client %d deregistrato ha richiesto un'operazione su un gruppo", req->cb.fd);
+    *(req->cb.is_connected) |= send_error_message(req->cb.fd, OP_FAIL, req->cb.pl, NULL, "Client non registrato");
+    return;
+  }
+
+  req->cd = (client_descriptor_t*)value;
+  req->user = id;
+  int res = chash_get(req->cb.pl->groups, req->msg->data.hdr.receiver, req->op, req);
+  HANDLE_FATAL(res, "chash_get");
 }
 
 /**
- * \brief Funzione chiamata da handle_del_group per eseguire la rimozione di un
- *        utente da un gruppo
+ * \brief Esegue un'operazione sul gruppo indicato in \p msg per conto
+ *        dell'utente \p user
  * 
- * \warning Questa procedura presuppone che il chiamante abbia ottenuto
- *          il blocco su \ref payload_t.connected_clients_mtx
+ * Sia il descrittore dell'utente che il gruppo vengono letti senza lock, e
+ * restano validi per tutta la durata di \p op.
  * 
- * \param key Il nome del gruppo da cui è stata tentata la rimozione
- * \param value Il gruppo da cui rimuovere l'utente. NULL se il gruppo non esiste
- * \param ud Dati di contesto (tipo: \ref callback_data*)
+ * \param fd Il descrittore del client che ha richiesto l'operazione
+ * \param msg Il messaggio ricevuto
+ * \param pl Dati di contesto
+ * \param is_connected Viene impostato a 0 se \p fd si disconnette durante
+ *                     l'operazione
+ * \param user L'utente connesso a \p fd
+ * \param op L'operazione da eseguire, chiamata con il gruppo
  */
-static void handle_del_group_cb(const char *key, void *value, void *ud) {
-  struct callback_data *cbdata = (struct callback_data*)ud;
-  cstrlist_t *list = (cstrlist_t*)value;
-
-  if(list == NULL) {
-    /* Tentativo di rimozione di un utente da un gruppo non esistente */
-    LOG_WARN("Il client %d ha tentato di rimuoversi da un gruppo non esistente", cbdata->fd);
+static void run_group_request(long fd, message_t *msg, payload_t *pl, int *is_connected,
+                              cintern_id_t user, chash_get_callback *op) {
+  struct group_request req;
+  memset(&req, 0, sizeof(struct group_request));
+  req.cb.pl = pl;
+  req.cb.fd = fd;
+  req.cb.is_connected = is_connected;
+  req.msg = msg;
+  req.op = op;
+
+  int res = cintern_get(pl->users, user, group_request_cb, &req);
+  HANDLE_FATAL(res, "cintern_get");
+}
 
-    *(cbdata->is_connected) |= send_error_message(cbdata->fd, OP_FAIL, cbdata->pl, NULL, "Gruppo inesistente", NULL);
-  } else {
-    int res = cstrlist_remove(list, cbdata->data);
-    if(res != 0) {
-      if(errno == ENOENT) {
-        LOG_WARN("Il client %d ha tentato di rimuoversi da un gruppo a cui non era iscritto", cbdata->fd);
-
-        *(cbdata->is_connected) |= send_error_message(cbdata->fd, OP_FAIL, cbdata->pl, NULL, "Utente non presente nel gruppo", NULL);
-      } else {
-        HANDLE_FATAL(res, "cstrlist_remove");
-      }
-    } else {
-      message_hdr_t ack;
-      memset(&ack, 0, sizeof(message_hdr_t));
-      ack.op = OP_OK;
+/**
+ * \brief Gestisce una richiesta di aggiunta ad un gruppo
+ * 
+ * \param fd Il descrittore del client che ha richiesto l'operazione
+ * \param msg Il messaggio ricevuto
+ * \param pl Dati di contesto
+ * \param is_connected Viene impostato a 0 se \p fd si disconnette durante
+ *                     l'operazione
+ */
+static void handle_add_group(long fd, message_t *msg, payload_t *pl, int *is_connected) {
+  assert(msg->hdr.op == ADDGROUP_OP);
 
-      res = send_header_handle_disconnect(cbdata->fd, &ack, cbdata->pl, NULL);
-      HANDLE_FATAL(res, "send_header_handle_disconnect");
-      *(cbdata->is_connected) |= res;
-    }
+  cintern_id_t user = get_connected_user(fd, pl);
+  if(user == CINTERN_NONE) {
+    /* Un client non connesso ha tentato di aggiungersi ad un gruppo */
+    LOG_WARN("Il client %ld non connesso ha tentato di aggiungersi ad un gruppo", fd);
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
+    return;
   }
+
+  run_group_request(fd, msg, pl, is_connected, user, handle_add_group_cb);
 }
 
 /**
@@ -1228,31 +1563,15 @@ static void handle_del_group_cb(const char *key, void *value, void *ud) {
 static void handle_del_group(long fd, message_t *msg, payload_t *pl, int *is_connected) {
   assert(msg->hdr.op == DELGROUP_OP);
 
-  int clientIdx = -1;
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    clientIdx = find_connected_client(fd, pl);
-  });
-
-  if(clientIdx == -1) {
+  cintern_id_t user = get_connected_user(fd, pl);
+  if(user == CINTERN_NONE) {
     /* Un client non connesso ha tentato di rimuoversi da un gruppo */
     LOG_WARN("Il client %ld non connesso ha tentato di rimuoversi da un gruppo", fd);
-    MUTEX_GUARD(pl->connected_clients_mtx, {
-      *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso", NULL);
-    });
+    *is_connected |= send_error_message(fd, OP_FAIL, pl, NULL, "Client non connesso");
     return;
   }
 
-  struct callback_data cbdata;
-  memset(&cbdata, 0, sizeof(struct callback_data));
-  cbdata.pl = pl;
-  cbdata.fd = fd;
-  cbdata.data = msg->hdr.sender;
-  cbdata.is_connected = is_connected;
-
-  MUTEX_GUARD(pl->connected_clients_mtx, {
-    int res = chash_get(pl->groups, msg->data.hdr.receiver, handle_del_group_cb, &cbdata);
-    HANDLE_FATAL(res, "chash_get");
-  });
+  run_group_request(fd, msg, pl, is_connected, user, handle_del_group_cb);
 }
 
 /* Inizializza la lookup-table dei gestori di richieste */
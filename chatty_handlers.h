@@ -10,12 +10,19 @@
 #ifndef CHATTY_HANDLERS_H_
 #define CHATTY_HANDLERS_H_
 
-#include <sys/select.h>
+#include <pthread.h>
 
 #include "chash.h"
+#include "csched.h"
+#include "cring.h"
 #include "cqueue.h"
+#include "msgbuf.h"
+#include "outqueue.h"
+#include "cmessage.h"
 #include "ccircbuf.h"
-#include "cstrlist.h"
+#include "cidset.h"
+#include "carena.h"
+#include "cintern.h"
 
 #include "stats.h"
 #include "message.h"
@@ -44,6 +51,18 @@
                                   { block; } \
                                   UNLOCK((mtx)); }
 
+/**
+ * \brief Modalità con cui i client vengono distribuiti ai thread del pool
+ * 
+ * Viene letta dall'opzione DispatchMode del file di configurazione, che può
+ * valere queue (predefinita), roundrobin o leastloaded.
+ */
+typedef enum {
+  DISPATCH_QUEUE = 0, ///< Il thread principale ascolta tutti i client e li distribuisce tramite lo scheduler
+  DISPATCH_ROUND_ROBIN, ///< Ogni thread ha il proprio event loop, i client sono assegnati a turno
+  DISPATCH_LEAST_LOADED ///< Ogni thread ha il proprio event loop, i client sono assegnati al meno carico
+} dispatch_mode_t;
+
 /**
  * \struct server_cfg
  * \brief Dati letti dai file di configurazione
@@ -52,53 +71,140 @@ struct server_cfg {
   char socketPath[MAX_PATH_LEN + 1]; ///< Path del socket su cui effettuare la connessione
   int maxConnections; ///< Massimo numero di client connessi ammesso
   int threadsInPool; ///< Numero di threads da spawnare per gestire le connessioni
+  int fileThreadsInPool; ///< Numero di threads dedicati alle operazioni sui file (0: gestite dagli altri)
   int maxMsgSize; ///< Massima lunghezza di un messaggio testuale
   int maxFileSize; ///< Massima lunghezza di un file inviato
   int maxHistMsgs; ///< Lunghezza massima della cronologia dei messaggi
   char dirName[MAX_PATH_LEN + 1]; ///< Nome della directory in cui depositare i file scambiati
   char statFileName[MAX_PATH_LEN + 1]; ///< Nome del file su cui memorizzare le statistiche
+  dispatch_mode_t dispatchMode; ///< Modalità di distribuzione dei client ai thread
+  int maxOutQueue; ///< Numero massimo di messaggi in attesa di essere inviati ad un client (0: illimitato)
+  outqueue_policy_t outQueuePolicy; ///< Comportamento quando la coda di uscita di un client è piena
 };
 
+/// Associa un descrittore alla generazione della sua coda di uscita
+#define CONN_HANDLE(fd, gen) ((long)(((unsigned long)(gen) << 32) | (unsigned long)(fd)))
+
+/// Descrittore contenuto in un valore di \ref CONN_HANDLE, -1 se non connesso
+#define CONN_FD(conn) ((conn) < 0 ? -1L : (long)((unsigned long)(conn) & 0xFFFFFFFFUL))
+
+/// Generazione contenuta in un valore di \ref CONN_HANDLE
+#define CONN_GEN(conn) ((unsigned int)((unsigned long)(conn) >> 32))
+
 /**
  * \brief Rappresenta un utente registrato
+ * 
+ * \ref conn contiene sia il descrittore che la generazione della sua coda
+ * di uscita: se il client si disconnette e il descrittore viene riassegnato
+ * ad un altro client mentre un messaggio viene instradato, la generazione
+ * non corrisponde più e il messaggio non viene inviato.
+ * 
+ * \ref groups è l'indice inverso dell'iscrizione ai gruppi: contiene tutti e
+ * soli i gruppi il cui insieme di membri contiene l'utente, ed è aggiornato
+ * insieme a questi mantenendo \ref groups_mtx.
  */
 typedef struct {
-  ccircbuf_t *message_buffer; ///< Mantiene la cronologia dei messaggi (tipo: \ref message_t*)
-  long fd; ///< Descrittore del socket al client
+  ccircbuf_t *message_buffer; ///< Mantiene la cronologia dei messaggi (tipo: \ref cmessage_t*)
+  long conn; ///< Descrittore del socket al client e generazione (\ref CONN_HANDLE), -1 se non connesso (accesso atomico)
+  pthread_mutex_t groups_mtx; ///< Mutex per l'accesso a \ref groups, \ref ngroups, \ref unregistered e \ref id
+  cidset_t **groups; ///< Gruppi di cui l'utente fa parte
+  int ngroups; ///< Numero di elementi di \ref groups
+  int groups_cap; ///< Capienza di \ref groups
+  int unregistered; ///< 1 se l'utente è stato deregistrato, e non può più essere aggiunto a gruppi
+  cintern_id_t id; ///< Identificatore dell'utente, impostato all'aggiunta ad un gruppo e usato per rimuoverlo dai gruppi alla deregistrazione
 } client_descriptor_t;
 
 /**
- * \brief Rappresenta un client che si è connesso
+ * \brief Stato di una connessione aperta
+ * 
+ * Il buffer di ingresso viene usato solamente dal thread che sta servendo la
+ * connessione, mentre la coda di uscita è condivisa da tutti i thread che
+ * inviano messaggi al client. \ref user e \ref online_idx sono protetti da
+ * \ref payload_t.connected_clients_mtx.
  */
 typedef struct {
-  char nick[MAX_NAME_LENGTH + 1]; ///< Il nickname associato al client
-  long fd; ///< Il socket associato al client
-} connected_client_t;
+  msgbuf_t in; ///< Buffer di ingresso
+  outqueue_t out; ///< Coda di uscita
+  cintern_id_t user; ///< Identificatore dell'utente con cui il client si è connesso
+  int online_idx; ///< Posizione in \ref payload_t.online, -1 se il client non è connesso
+} connection_t;
+
+struct event_loop;
 
 /**
  * \brief Dati da passare ai thread come contesto di lavoro
  */
 typedef struct {
-  fd_set set; ///< Bitset dei descrittori su cui ascoltare
-  pthread_mutex_t set_mtx; ///< Mutex per l'accesso al bitset dei descrittori
-
-  cqueue_t *ready_sockets; ///< Coda dei socket pronti (tipo: int)
-  chash_t *registered_clients; ///< Tabella degli utenti registrati (tipo: \ref client_descriptor_t*)
-  chash_t *groups; ///< Tabella dei gruppi registrati (tipo: \ref cstrlist*)
-  connected_client_t *connected_clients; ///< Vettore di client connessi
-  pthread_mutex_t connected_clients_mtx; ///< Mutex per l'accesso a \ref connected_clients
+  int epoll_fd; ///< Istanza epoll su cui vengono ascoltati i descrittori
+  int wakeup_fd; ///< eventfd usato per risvegliare gli event loop alla terminazione
+  int out_epoll_fd; ///< Istanza epoll su cui si attende che i client con messaggi in coda siano scrivibili
+  struct event_loop *loops; ///< Event loop dei thread, NULL se \ref server_cfg.dispatchMode è \ref DISPATCH_QUEUE
+  int next_loop; ///< Prossimo event loop a cui assegnare un client in modalità round-robin
+
+  csched_t *ready_sockets; ///< Scheduler dei socket pronti
+  cqueue_t *file_jobs; ///< Operazioni sui file in attesa, NULL se \ref server_cfg.fileThreadsInPool è 0
+  cqueue_t *tasks; ///< Operazioni in attesa di essere eseguite dai thread del pool (tipo: \ref chatty_task_t*)
+  int task_fd; ///< eventfd (semaforo) che conta le operazioni in \ref tasks, usato dagli event loop
+  unsigned int next_task; ///< Prossimo thread a cui affidare un'operazione in modalità \ref DISPATCH_QUEUE (accesso atomico)
+  cintern_t *users; ///< Utenti registrati, indicizzati per nickname e per identificatore (tipo: \ref client_descriptor_t*)
+  chash_t *groups; ///< Tabella dei gruppi registrati (tipo: \ref cidset_t*)
+  long *online; ///< Descrittori dei client connessi, in posizioni contigue
+  int nonline; ///< Numero di elementi di \ref online
+  connection_t *conns; ///< Connessioni aperte, indicizzate per descrittore
+  long max_fds; ///< Numero di elementi di \ref conns
+  pthread_mutex_t connected_clients_mtx; ///< Mutex per l'accesso a \ref online e ai client connessi di \ref conns. Viene mantenuto solo per brevi sezioni critiche, senza mai acquisire altri lock oltre a \ref stats_mtx
   struct server_cfg *cfg; ///< Parametri di configurazione del server
 
   pthread_mutex_t stats_mtx; ///< Mutex per l'accesso alle statistiche
   struct statistics chatty_stats; ///< Statistiche del server
 } payload_t;
 
+/**
+ * \brief Event loop di un thread del pool
+ */
+typedef struct event_loop {
+  payload_t *pl; ///< Dati di contesto
+  int epoll_fd; ///< Istanza epoll su cui vengono ascoltati i client assegnati al thread
+  long nclients; ///< Numero di client assegnati (accesso atomico)
+  cring_t *ready; ///< Client con richieste complete ancora da servire, in attesa del loro turno
+  int ready_fd; ///< eventfd usato per risvegliare il thread quando un client viene messo in \ref ready da un altro thread
+} event_loop_t;
+
+/**
+ * \brief Operazione eseguita da un thread del pool
+ * 
+ * \param arg Argomento dell'operazione, di cui l'operazione è responsabile
+ * \param pl Dati di contesto
+ */
+typedef void(chatty_task_fn)(void *arg, payload_t *pl);
+
+/**
+ * \brief Operazione in attesa di essere eseguita
+ */
+typedef struct {
+  chatty_task_fn *fn; ///< La funzione da eseguire
+  void *arg; ///< L'argomento da passare a \ref fn
+} chatty_task_t;
+
+/**
+ * \brief Affida un'operazione ai thread del pool, senza attenderne il termine
+ * 
+ * Le operazioni ancora in attesa alla terminazione del server vengono
+ * eseguite dal thread principale.
+ * 
+ * \param pl Dati di contesto
+ * \param fn La funzione da eseguire
+ * \param arg L'argomento da passare a \p fn
+ */
+void dispatch_task(payload_t *pl, chatty_task_fn *fn, void *arg);
+
 /**
  * \brief Rappresenta un pacchetto da inviare a un client
  */
 typedef struct {
   payload_t *pl; ///< Dati di contesto
   message_t message; ///< Il messaggio da inviare
+  cmessage_t *shared; ///< Copia condivisa del messaggio, creata per il primo destinatario
   long fd; ///< Il descrittore del mittente
   int broadcast; ///< 1 se il messaggio è diretto a più utenti, 0 altrimenti
   int sent; ///< 1 se il messaggio è stato inviato ad un gruppo, 0 altrimenti
@@ -108,8 +214,7 @@ typedef struct {
 /**
  * \brief Gestisce la disconnessione di un client
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
+ * Non va chiamata con \ref payload_t.connected_clients_mtx acquisito.
  * 
  * \param fd Il socket che si è disconnesso
  * \param client Il descrittore del client da disconnetere, se disponibile
@@ -137,7 +242,19 @@ typedef void(chatty_request_handler)(long fd, message_t *msg, payload_t *pl, int
 /**
  * \brief Vettore delle funzioni di gestione delle richieste
  */
-chatty_request_handler *chatty_handlers[OP_END];
+extern chatty_request_handler *chatty_handlers[OP_END];
+
+/**
+ * \brief Restituisce l'arena per le allocazioni temporanee della richiesta
+ *        servita dal thread corrente
+ * 
+ * Ogni thread che serve richieste ha la propria arena, che viene ripristinata
+ * al termine di ogni richiesta: i buffer allocati da un gestore non vanno
+ * deallocati, ma non vanno nemmeno conservati oltre la richiesta.
+ * 
+ * \return carena_t* L'arena, NULL se il thread non serve richieste
+ */
+carena_t *request_arena(void);
 
 /**
  * \brief Crea un messaggio d'errore da inviare ad un client
@@ -150,19 +267,19 @@ chatty_request_handler *chatty_handlers[OP_END];
 void make_error_message(message_t *msg, op_t error, const char *receiver, const char *text);
 
 /**
- * \brief Invia un messaggio d'errore ad un client e gestisce automaticamente l'eventuale disconnessione
+ * \brief Invia un messaggio d'errore ad un client
  * 
- * \warning Questa procedura presuppone che il chiamante abbia bloccato
- *          \ref payload_t.connected_clients_mtx
+ * Il messaggio viene accodato all'uscita del client: se il client si è
+ * disconnesso, la disconnessione viene gestita dal thread che lo legge.
  * 
  * \param fd Il descrittore a cui inviare l'errore
  * \param error Il codice d'errore da inviare
  * \param pl Dati di contesto
  * \param receiver Nome del destinatario (opzionale)
- * \param client Il descrittore del client da disconnetere in caso di errori, se disponibile
  * \param text Testo d'errore (opzionale)
+ * \return int 0 se il client si è disconnesso, altro altrimenti
  */
 int send_error_message(long fd, op_t error, payload_t *pl, const char *receiver,
-                       const char *text, client_descriptor_t *client);
+                       const char *text);
 
 #endif
\ No newline at end of file
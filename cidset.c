@@ -0,0 +1,234 @@
+/**
+ *  \file cidset.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include "cidset.h"
+#include "cebr.h"
+
+/// Capienza minima della tabella di un'istantanea, potenza di 2
+#define MIN_CAPACITY 8
+
+#define CHECK_RET if(ret != 0) { \
+                    errno = ret; \
+                    return -1; \
+                  }
+
+/**
+ * \brief Istantanea immutabile del contenuto di un insieme
+ *
+ * Le posizioni libere della tabella contengono \ref CINTERN_NONE, e le
+ * collisioni sono risolte con scansione lineare. Dato che le istantanee non
+ * vengono mai modificate dopo la pubblicazione, non servono marcatori per
+ * gli elementi rimossi. La tabella è riempita al più per metà.
+ */
+typedef struct snapshot {
+  size_t n; ///< Numero di elementi
+  size_t mask; ///< Capienza della tabella meno uno
+  cintern_id_t *slots; ///< Tabella degli elementi, allocata dopo \ref ids
+  cintern_id_t ids[]; ///< Elenco degli elementi
+} snapshot_t;
+
+/**
+ * \brief Insieme concorrente di identificatori
+ */
+struct cidset {
+  pthread_mutex_t mtx; ///< Mutex che serializza le modifiche
+  snapshot_t *snap; ///< Istantanea corrente, acceduta in maniera atomica
+};
+
+/**
+ * \brief Posizione iniziale di un identificatore nella tabella
+ *
+ * Gli identificatori sono piccoli e consecutivi, per cui vengono mescolati
+ * con una moltiplicazione prima di ridurli alla dimensione della tabella.
+ */
+static size_t slot_of(const snapshot_t *snap, cintern_id_t id) {
+  return (size_t)((id * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & snap->mask;
+}
+
+/**
+ * \brief Cerca un identificatore nella tabella di un'istantanea
+ *
+ * \return size_t La posizione dell'identificatore se presente, altrimenti la
+ *                posizione libera in cui andrebbe inserito
+ */
+static size_t find_slot(const snapshot_t *snap, cintern_id_t id) {
+  size_t i = slot_of(snap, id);
+  while(snap->slots[i] != CINTERN_NONE && snap->slots[i] != id) {
+    i = (i + 1) & snap->mask;
+  }
+  return i;
+}
+
+/**
+ * \brief Crea un'istantanea contenente gli elementi di \p old, più \p add
+ *        e meno \p del
+ *
+ * \param old L'istantanea da copiare, NULL per partire da un insieme vuoto
+ * \param add L'identificatore da aggiungere, \ref CINTERN_NONE per nessuno
+ * \param del L'identificatore da rimuovere, \ref CINTERN_NONE per nessuno
+ * \param capacity Numero minimo di elementi da prevedere
+ * \return snapshot_t* La nuova istantanea, NULL e errno impostato in caso di errore
+ */
+static snapshot_t *snapshot_build(const snapshot_t *old, cintern_id_t add, cintern_id_t del, size_t capacity) {
+  size_t n = old == NULL ? 0 : old->n;
+  if(add != CINTERN_NONE) n++;
+  if(capacity < n) capacity = n;
+
+  size_t cap = MIN_CAPACITY;
+  while(cap / 2 < capacity) cap *= 2;
+
+  snapshot_t *snap = malloc(sizeof(snapshot_t) + (n + cap) * sizeof(cintern_id_t));
+  if(snap == NULL) return NULL;
+
+  snap->n = 0;
+  snap->mask = cap - 1;
+  snap->slots = snap->ids + n;
+  for(size_t i = 0; i < cap; i++) {
+    snap->slots[i] = CINTERN_NONE;
+  }
+
+  for(size_t i = 0; old != NULL && i < old->n; i++) {
+    if(old->ids[i] != del) {
+      snap->ids[snap->n++] = old->ids[i];
+    }
+  }
+  if(add != CINTERN_NONE) {
+    snap->ids[snap->n++] = add;
+  }
+
+  for(size_t i = 0; i < snap->n; i++) {
+    snap->slots[find_slot(snap, snap->ids[i])] = snap->ids[i];
+  }
+
+  return snap;
+}
+
+cidset_t *cidset_init(size_t capacity) {
+  cidset_t *set = calloc(1, sizeof(cidset_t));
+  if(!set) return NULL;
+
+  set->snap = snapshot_build(NULL, CINTERN_NONE, CINTERN_NONE, capacity);
+  if(!set->snap) {
+    free(set);
+    return NULL;
+  }
+
+  int ret;
+  if((ret = pthread_mutex_init(&(set->mtx), NULL)) != 0) {
+    free(set->snap);
+    free(set);
+    errno = ret;
+    return NULL;
+  }
+
+  return set;
+}
+
+int cidset_deinit(cidset_t *set) {
+  if(set == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  free(set->snap);
+
+  int ret = 0;
+  if((ret = pthread_mutex_destroy(&(set->mtx))) != 0) {
+    errno = ret;
+    ret = -1;
+  }
+
+  free(set);
+  return ret;
+}
+
+/**
+ * \brief Sostituisce l'istantanea corrente con una che contiene \p add e non
+ *        contiene \p del
+ *
+ * \return int 0 in caso di successo, -1 e errno impostato in caso di errore
+ */
+static int update(cidset_t *set, cintern_id_t add, cintern_id_t del) {
+  int ret = pthread_mutex_lock(&(set->mtx));
+  CHECK_RET
+
+  int res = 0;
+  snapshot_t *old = set->snap;
+  if(add != CINTERN_NONE && old->slots[find_slot(old, add)] == add) {
+    errno = EALREADY;
+    res = -1;
+  } else if(del != CINTERN_NONE && old->slots[find_slot(old, del)] != del) {
+    errno = ENOENT;
+    res = -1;
+  } else {
+    snapshot_t *snap = snapshot_build(old, add, del, 0);
+    if(snap == NULL) {
+      res = -1;
+    } else {
+      /* I lettori che hanno già ottenuto la vecchia istantanea possono
+         continuare ad usarla fino all'uscita dalla loro sezione critica */
+      __atomic_store_n(&(set->snap), snap, __ATOMIC_RELEASE);
+      res = cebr_retire(old, free);
+    }
+  }
+
+  ret = pthread_mutex_unlock(&(set->mtx));
+  CHECK_RET
+  return res;
+}
+
+int cidset_insert(cidset_t *set, cintern_id_t id) {
+  if(set == NULL || id == CINTERN_NONE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return update(set, id, CINTERN_NONE);
+}
+
+int cidset_remove(cidset_t *set, cintern_id_t id) {
+  if(set == NULL || id == CINTERN_NONE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return update(set, CINTERN_NONE, id);
+}
+
+int cidset_contains(cidset_t *set, cintern_id_t id) {
+  if(set == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if(id == CINTERN_NONE) return 0;
+
+  cebr_enter();
+  snapshot_t *snap = __atomic_load_n(&(set->snap), __ATOMIC_ACQUIRE);
+  int found = snap->slots[find_slot(snap, id)] == id;
+  cebr_exit();
+
+  return found;
+}
+
+int cidset_get_members(cidset_t *set, cidset_members_callback *cb, void *ud) {
+  if(set == NULL || cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cebr_enter();
+  snapshot_t *snap = __atomic_load_n(&(set->snap), __ATOMIC_ACQUIRE);
+  cb(snap->ids, snap->n, ud);
+  cebr_exit();
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ *  \file cidset.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Insieme concorrente di identificatori
+ * Consente di gestire un insieme di identificatori di \ref cintern fra più
+ * thread, con ricerca in tempo costante.
+ *
+ * Implementato con istantanee immutabili, ognuna delle quali contiene
+ * l'elenco degli elementi e una tabella ad indirizzamento aperto per
+ * cercarli. Ogni modifica copia l'istantanea corrente, e richiede quindi
+ * tempo proporzionale al numero di elementi. Le letture non acquisiscono
+ * alcun lock: leggono l'istantanea corrente all'interno di una sezione
+ * critica di \ref cebr_enter. Le modifiche sono serializzate da un mutex, e
+ * ognuna pubblica una nuova istantanea e ritira la precedente tramite
+ * \ref cebr_retire. L'insieme è quindi adatto a casi in cui le letture sono
+ * molto più frequenti delle modifiche.
+ */
+
+#ifndef CIDSET_H
+#define CIDSET_H
+
+#include <stddef.h>
+#include "cintern.h"
+
+/// Insieme concorrente di identificatori
+typedef struct cidset cidset_t;
+
+/**
+ * \brief Tipo della funzione di callback che viene chiamata con l'elenco
+ *        degli elementi di un insieme
+ *
+ * \param ids Gli elementi, in ordine arbitrario. Il vettore non va
+ *            modificato, e resta valido solo fino al termine della callback
+ * \param n Il numero di elementi
+ * \param ud Dati arbitrari passati dall'utente
+ */
+typedef void(cidset_members_callback)(const cintern_id_t *ids, size_t n, void *ud);
+
+/**
+ * \brief Inizializza un nuovo insieme
+ *
+ * \param capacity Numero di elementi previsti. L'insieme cresce comunque in
+ *                 base al numero di elementi inseriti
+ * \return cidset_t* NULL e errno impostato in caso di errori
+ */
+cidset_t *cidset_init(size_t capacity);
+
+/**
+ * \brief Distrugge un insieme
+ *
+ * Va chiamata solo quando nessun altro thread può accedere all'insieme
+ *
+ * \param set L'insieme da distruggere
+ * \return int 0 in caso di successo, -1 e errno impostato in caso di errori
+ */
+int cidset_deinit(cidset_t *set);
+
+/**
+ * \brief Inserisce un identificatore nell'insieme
+ *
+ * Se l'identificatore era già presente, la chiamata fallisce con errno
+ * impostato a EALREADY
+ *
+ * \param set L'insieme in cui inserire l'identificatore
+ * \param id L'identificatore da inserire, diverso da \ref CINTERN_NONE
+ * \return int 0 in caso di successo, -1 e errno impostato in caso di errore
+ */
+int cidset_insert(cidset_t *set, cintern_id_t id);
+
+/**
+ * \brief Rimuove un identificatore dall'insieme
+ *
+ * Se l'identificatore non era presente, la chiamata fallisce con errno
+ * impostato a ENOENT
+ *
+ * \param set L'insieme da cui rimuovere l'identificatore
+ * \param id L'identificatore da rimuovere
+ * \return int 0 in caso di successo, -1 e errno impostato in caso di errore
+ */
+int cidset_remove(cidset_t *set, cintern_id_t id);
+
+/**
+ * \brief Controlla se un identificatore fa parte dell'insieme
+ *
+ * \param set L'insieme in cui cercare
+ * \param id L'identificatore da cercare
+ * \return int 1 se presente, 0 se assente, -1 e errno impostato in caso di errore
+ */
+int cidset_contains(cidset_t *set, cintern_id_t id);
+
+/**
+ * \brief Chiama una funzione sull'elenco degli elementi attualmente
+ *        contenuti nell'insieme
+ *
+ * L'elenco non viene copiato: è quello dell'istantanea corrente, e non
+ * cambia durante la callback anche se nel frattempo l'insieme viene
+ * modificato. La callback viene eseguita senza lock all'interno di una
+ * sezione critica di \ref cebr_enter, per cui va tenuta breve, e può
+ * essere eseguita in parallelo da più thread.
+ *
+ * \param set L'insieme
+ * \param cb La funzione da chiamare
+ * \param ud Dati da passare alla callback
+ * \return int 0 in caso di successo, -1 e errno impostato in caso di errore
+ */
+int cidset_get_members(cidset_t *set, cidset_members_callback *cb, void *ud);
+
+#endif /* CIDSET_H */
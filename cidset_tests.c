@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cidset.h"
+#include "cebr.h"
+
+#define N 2000
+#define WRITERS 4
+#define ROUNDS 19200
+#define STABLE 100
+
+cidset_t *set;
+int done = 0;
+
+/* Gli identificatori inseriti sono volutamente consecutivi, come quelli
+   assegnati da cintern */
+void *writer(void *ud) {
+  cintern_id_t base = 1000000 + *(int*)ud * 1000;
+
+  for(int i = 0; i < ROUNDS; i++) {
+    cintern_id_t id = base + i % 64;
+    if(cidset_insert(set, id) != 0) {
+      assert(errno == EALREADY);
+      assert(cidset_remove(set, id) == 0);
+    }
+  }
+  return NULL;
+}
+
+/* Salva una copia dell'elenco */
+void copy_cb(const cintern_id_t *ids, size_t n, void *ud) {
+  cintern_id_t **dest = (cintern_id_t**)ud;
+  *dest = malloc((n + 1) * sizeof(cintern_id_t));
+  (*dest)[0] = n;
+  memcpy(*dest + 1, ids, n * sizeof(cintern_id_t));
+}
+
+/* L'elenco non cambia mentre lo si legge, e contiene sempre gli elementi
+   stabili esattamente una volta */
+void check_cb(const cintern_id_t *ids, size_t n, void *ud) {
+  int seen[STABLE];
+  memset(seen, 0, sizeof(seen));
+
+  for(size_t i = 0; i < n; i++) {
+    if(ids[i] <= STABLE) seen[ids[i] - 1]++;
+  }
+  for(int i = 0; i < STABLE; i++) {
+    assert(seen[i] == 1);
+    assert(cidset_contains(set, i + 1) == 1);
+  }
+  for(size_t i = 0; i < n; i++) {
+    assert(ids[i] != CINTERN_NONE);
+  }
+}
+
+void *reader(void *ud) {
+  while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+    assert(cidset_get_members(set, check_cb, NULL) == 0);
+  }
+  return NULL;
+}
+
+int main(void) {
+  set = cidset_init(0);
+  assert(set != NULL);
+
+  assert(cidset_insert(set, CINTERN_NONE) == -1 && errno == EINVAL);
+  assert(cidset_contains(set, CINTERN_NONE) == 0);
+
+  /* Inserimenti con crescita della tabella */
+  for(cintern_id_t i = 1; i <= N; i++) {
+    assert(cidset_insert(set, i) == 0);
+  }
+  assert(cidset_insert(set, 1) == -1 && errno == EALREADY);
+  for(cintern_id_t i = 1; i <= N; i++) {
+    assert(cidset_contains(set, i) == 1);
+  }
+  assert(cidset_contains(set, N + 1) == 0);
+
+  cintern_id_t *a;
+  assert(cidset_get_members(set, copy_cb, &a) == 0);
+  assert(a[0] == N);
+  long sum = 0;
+  for(size_t i = 1; i <= a[0]; i++) sum += a[i];
+  assert(sum == (long)N * (N + 1) / 2);
+  free(a);
+
+  /* Rimozioni: gli elementi rimasti devono restare raggiungibili */
+  for(cintern_id_t i = 1; i <= N; i += 2) {
+    assert(cidset_remove(set, i) == 0);
+  }
+  assert(cidset_remove(set, 1) == -1 && errno == ENOENT);
+  for(cintern_id_t i = 1; i <= N; i++) {
+    assert(cidset_contains(set, i) == (i % 2 == 0));
+  }
+
+  assert(cidset_get_members(set, copy_cb, &a) == 0);
+  assert(a[0] == N / 2);
+  for(size_t i = 1; i <= a[0]; i++) {
+    assert(a[i] % 2 == 0);
+  }
+  free(a);
+
+  for(cintern_id_t i = 2; i <= N; i += 2) {
+    assert(cidset_remove(set, i) == 0);
+  }
+  assert(cidset_get_members(set, copy_cb, &a) == 0);
+  assert(a[0] == 0);
+  free(a);
+
+  /* Letture senza lock in parallelo con inserimenti e rimozioni */
+  for(cintern_id_t i = 1; i <= STABLE; i++) {
+    assert(cidset_insert(set, i) == 0);
+  }
+
+  pthread_t readers[2], writers[WRITERS];
+  int ids[WRITERS];
+  for(int i = 0; i < 2; i++) {
+    pthread_create(readers + i, NULL, reader, NULL);
+  }
+  for(int i = 0; i < WRITERS; i++) {
+    ids[i] = i;
+    pthread_create(writers + i, NULL, writer, ids + i);
+  }
+  for(int i = 0; i < WRITERS; i++) {
+    pthread_join(writers[i], NULL);
+  }
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  for(int i = 0; i < 2; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  /* Ogni identificatore temporaneo è stato inserito e rimosso lo stesso
+     numero di volte */
+  assert(cidset_get_members(set, copy_cb, &a) == 0);
+  assert(a[0] == STABLE);
+  free(a);
+
+  assert(cidset_deinit(set) == 0);
+  cebr_flush();
+  return 0;
+}
@@ -0,0 +1,396 @@
+/**
+ *  \file cintern.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "cintern.h"
+#include "chash.h"
+#include "cebr.h"
+
+/// Numero di bit dell'identificatore che contengono l'indice
+#define INDEX_BITS 24
+
+/// Maschera dell'indice di un identificatore
+#define INDEX_MASK ((1u << INDEX_BITS) - 1)
+
+/// Maschera della generazione di un identificatore, dopo lo scorrimento
+#define GEN_MASK ((1u << (32 - INDEX_BITS)) - 1)
+
+/// Numero di bit dell'indice che selezionano lo slot all'interno di un blocco
+#define CHUNK_BITS 10
+
+/// Numero di slot di un blocco
+#define CHUNK_SIZE (1u << CHUNK_BITS)
+
+/// Numero massimo di blocchi
+#define NUM_CHUNKS (1u << (INDEX_BITS - CHUNK_BITS))
+
+#define ID_INDEX(id) ((id) & INDEX_MASK)
+#define MAKE_ID(gen, idx) ((cintern_id_t)(((gen) << INDEX_BITS) | (idx)))
+
+/**
+ * \brief Posizione di un nome nella tabella
+ *
+ * \ref id viene pubblicato dopo \ref name e \ref value, e invalidato prima
+ * che lo slot venga riutilizzato: chi legge lo slot senza lock ricontrolla
+ * \ref id dopo aver letto gli altri campi.
+ */
+typedef struct {
+  cintern_id_t id; ///< Identificatore del nome, \ref CINTERN_NONE se lo slot è libero (accesso atomico)
+  char *name; ///< Il nome (accesso atomico)
+  void *value; ///< Il valore associato al nome (accesso atomico)
+  uint32_t gen; ///< Generazione con cui lo slot verrà usato la prossima volta
+  uint32_t next_free; ///< Indice del successivo slot libero, 0 se è l'ultimo
+} cintern_slot_t;
+
+/**
+ * \brief Tabella di nomi internati
+ *
+ * Gli slot sono suddivisi in blocchi allocati quando servono e mai spostati,
+ * per cui un indice corrisponde sempre allo stesso slot. L'indice 0 non
+ * viene usato, in modo che nessun identificatore valga \ref CINTERN_NONE.
+ */
+struct cintern {
+  pthread_mutex_t mtx; ///< Serializza inserimenti e rimozioni
+  chash_t *names; ///< Identificatori dei nomi presenti, indicizzati per nome
+  uint32_t next; ///< Primo indice mai usato (accesso atomico)
+  uint32_t free_head; ///< Primo slot libero da riutilizzare, 0 se nessuno
+  uint32_t free_tail; ///< Ultimo slot libero da riutilizzare
+  cintern_slot_t *chunks[NUM_CHUNKS]; ///< Blocchi di slot (accesso atomico)
+};
+
+/**
+ * \brief Restituisce lo slot con indice \p idx, NULL se il suo blocco non
+ *        è ancora stato allocato
+ */
+static cintern_slot_t *slot_at(cintern_t *t, uint32_t idx) {
+  cintern_slot_t *chunk = __atomic_load_n(&(t->chunks[idx >> CHUNK_BITS]), __ATOMIC_ACQUIRE);
+  return chunk == NULL ? NULL : &(chunk[idx & (CHUNK_SIZE - 1)]);
+}
+
+/**
+ * \brief Legge nome e valore associati ad un identificatore. Va chiamata
+ *        all'interno di una sezione critica
+ *
+ * \return int 1 se l'identificatore è valido, 0 altrimenti
+ */
+static int read_slot(cintern_t *t, cintern_id_t id, char **name, void **value) {
+  if(id == CINTERN_NONE) return 0;
+
+  cintern_slot_t *s = slot_at(t, ID_INDEX(id));
+  if(s == NULL || __atomic_load_n(&(s->id), __ATOMIC_ACQUIRE) != id) return 0;
+
+  *name = __atomic_load_n(&(s->name), __ATOMIC_RELAXED);
+  *value = __atomic_load_n(&(s->value), __ATOMIC_RELAXED);
+
+  /* Lo slot potrebbe essere stato liberato e riutilizzato nel frattempo */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&(s->id), __ATOMIC_RELAXED) == id;
+}
+
+cintern_t *cintern_init(size_t capacity) {
+  cintern_t *t = calloc(1, sizeof(cintern_t));
+  if(t == NULL) return NULL;
+
+  int ret = pthread_mutex_init(&(t->mtx), NULL);
+  if(ret != 0) {
+    free(t);
+    errno = ret;
+    return NULL;
+  }
+
+  t->names = chash_init(capacity);
+  if(t->names == NULL) {
+    int err = errno;
+    pthread_mutex_destroy(&(t->mtx));
+    free(t);
+    errno = err;
+    return NULL;
+  }
+
+  t->next = 1;
+  return t;
+}
+
+int cintern_deinit(cintern_t *t, cintern_deinitializer *cb) {
+  if(t == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(uint32_t idx = 1; idx < t->next; idx++) {
+    cintern_slot_t *s = slot_at(t, idx);
+    if(s->id != CINTERN_NONE) {
+      if(cb != NULL) cb(s->value);
+      free(s->name);
+    }
+  }
+  for(uint32_t i = 0; i < NUM_CHUNKS; i++) {
+    free(t->chunks[i]);
+  }
+
+  int err = 0;
+  if(chash_deinit(t->names, NULL) != 0) err = errno;
+  int ret = pthread_mutex_destroy(&(t->mtx));
+  if(ret != 0) err = ret;
+  free(t);
+
+  if(err != 0) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+static void find_cb(const char *key, void *value, void *ud) {
+  *(cintern_id_t*)ud = (cintern_id_t)(uintptr_t)value;
+}
+
+cintern_id_t cintern_find(cintern_t *t, const char *name) {
+  cintern_id_t id = CINTERN_NONE;
+  if(t != NULL && name != NULL) {
+    chash_get(t->names, name, find_cb, &id);
+  }
+  return id;
+}
+
+/**
+ * \brief Sceglie lo slot in cui inserire un nuovo nome. Va chiamata con il
+ *        mutex acquisito
+ *
+ * \return uint32_t L'indice dello slot, 0 ed errno impostato in caso di errore
+ */
+static uint32_t take_slot(cintern_t *t) {
+  /* Gli slot liberati vengono riutilizzati per primi, dal meno recente */
+  if(t->free_head != 0) {
+    uint32_t idx = t->free_head;
+    t->free_head = slot_at(t, idx)->next_free;
+    if(t->free_head == 0) t->free_tail = 0;
+    return idx;
+  }
+
+  uint32_t idx = t->next;
+  if(idx > INDEX_MASK) {
+    errno = ENOSPC;
+    return 0;
+  }
+
+  uint32_t chunk = idx >> CHUNK_BITS;
+  if(t->chunks[chunk] == NULL) {
+    cintern_slot_t *slots = calloc(CHUNK_SIZE, sizeof(cintern_slot_t));
+    if(slots == NULL) return 0;
+    __atomic_store_n(&(t->chunks[chunk]), slots, __ATOMIC_RELEASE);
+  }
+
+  __atomic_store_n(&(t->next), idx + 1, __ATOMIC_RELEASE);
+  return idx;
+}
+
+/**
+ * \brief Restituisce uno slot a quelli liberi. Va chiamata con il mutex
+ *        acquisito
+ *
+ * Uno slot che ha esaurito le generazioni viene ritirato definitivamente:
+ * riutilizzarlo ripartendo dalla prima generazione restituirebbe
+ * identificatori già assegnati, che potrebbero essere ancora in uso.
+ */
+static void release_slot(cintern_t *t, uint32_t idx) {
+  cintern_slot_t *s = slot_at(t, idx);
+  if(s->gen == GEN_MASK) return;
+  s->gen++;
+  s->next_free = 0;
+
+  if(t->free_tail == 0) {
+    t->free_head = idx;
+  } else {
+    slot_at(t, t->free_tail)->next_free = idx;
+  }
+  t->free_tail = idx;
+}
+
+int cintern_add(cintern_t *t, const char *name, void *value, cintern_id_t *id) {
+  if(t == NULL || name == NULL || value == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int ret = pthread_mutex_lock(&(t->mtx));
+  if(ret != 0) {
+    errno = ret;
+    return -1;
+  }
+
+  cintern_id_t existing = cintern_find(t, name);
+  if(existing != CINTERN_NONE) {
+    pthread_mutex_unlock(&(t->mtx));
+    if(id != NULL) *id = existing;
+    return 1;
+  }
+
+  size_t len = strlen(name);
+  char *copy = malloc(len + 1);
+  uint32_t idx = copy == NULL ? 0 : take_slot(t);
+  if(idx == 0) {
+    int err = errno;
+    free(copy);
+    pthread_mutex_unlock(&(t->mtx));
+    errno = err;
+    return -1;
+  }
+  memcpy(copy, name, len + 1);
+
+  /* Lo slot viene pubblicato prima del nome, in modo che una ricerca che
+     trova il nome trovi anche lo slot */
+  cintern_slot_t *s = slot_at(t, idx);
+  cintern_id_t newId = MAKE_ID(s->gen, idx);
+  __atomic_store_n(&(s->name), copy, __ATOMIC_RELAXED);
+  __atomic_store_n(&(s->value), value, __ATOMIC_RELAXED);
+  __atomic_store_n(&(s->id), newId, __ATOMIC_RELEASE);
+
+  if(chash_set_if_empty(t->names, name, (void*)(uintptr_t)newId) != 0) {
+    int err = errno;
+    __atomic_store_n(&(s->id), CINTERN_NONE, __ATOMIC_RELEASE);
+    release_slot(t, idx);
+    pthread_mutex_unlock(&(t->mtx));
+    /* Il nome potrebbe essere stato letto da cintern_get_all */
+    cebr_retire(copy, free);
+    errno = err;
+    return -1;
+  }
+
+  pthread_mutex_unlock(&(t->mtx));
+  if(id != NULL) *id = newId;
+  return 0;
+}
+
+int cintern_remove(cintern_t *t, const char *name, void **oldValue) {
+  if(t == NULL || name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int ret = pthread_mutex_lock(&(t->mtx));
+  if(ret != 0) {
+    errno = ret;
+    return -1;
+  }
+
+  void *old = NULL;
+  if(chash_set(t->names, name, NULL, &old) != 0) {
+    int err = errno;
+    pthread_mutex_unlock(&(t->mtx));
+    errno = err;
+    return -1;
+  }
+
+  cintern_id_t id = (cintern_id_t)(uintptr_t)old;
+  void *value = NULL;
+  if(id != CINTERN_NONE) {
+    uint32_t idx = ID_INDEX(id);
+    cintern_slot_t *s = slot_at(t, idx);
+    value = s->value;
+
+    /* L'invalidazione deve essere visibile prima che lo slot venga
+       riutilizzato */
+    __atomic_store_n(&(s->id), CINTERN_NONE, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    release_slot(t, idx);
+
+    if(cebr_retire(s->name, free) != 0) {
+      int err = errno;
+      pthread_mutex_unlock(&(t->mtx));
+      errno = err;
+      return -1;
+    }
+  }
+
+  pthread_mutex_unlock(&(t->mtx));
+  if(oldValue != NULL) *oldValue = value;
+  return 0;
+}
+
+int cintern_get(cintern_t *t, cintern_id_t id, cintern_get_callback *cb, void *ud) {
+  if(t == NULL || cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *name;
+  void *value;
+  cebr_enter();
+  if(read_slot(t, id, &name, &value)) {
+    cb(id, name, value, ud);
+  } else {
+    cb(CINTERN_NONE, NULL, NULL, ud);
+  }
+  cebr_exit();
+  return 0;
+}
+
+int cintern_lookup(cintern_t *t, const char *name, cintern_get_callback *cb, void *ud) {
+  if(t == NULL || name == NULL || cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  char *interned;
+  void *value;
+  cebr_enter();
+  cintern_id_t id = cintern_find(t, name);
+  if(read_slot(t, id, &interned, &value)) {
+    cb(id, interned, value, ud);
+  } else {
+    cb(CINTERN_NONE, name, NULL, ud);
+  }
+  cebr_exit();
+  return 0;
+}
+
+int cintern_name(cintern_t *t, cintern_id_t id, char *buf, size_t size) {
+  if(t == NULL || buf == NULL || size == 0) return 0;
+
+  char *name;
+  void *value;
+  cebr_enter();
+  int valid = read_slot(t, id, &name, &value);
+  if(valid) {
+    size_t len = strlen(name);
+    if(len >= size) len = size - 1;
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+  }
+  cebr_exit();
+  return valid;
+}
+
+int cintern_get_all(cintern_t *t, cintern_get_callback *cb, void *ud) {
+  if(t == NULL || cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint32_t next = __atomic_load_n(&(t->next), __ATOMIC_ACQUIRE);
+
+  /* Ogni blocco viene visitato in una diversa sezione critica */
+  for(uint32_t start = 0; start < next; start += CHUNK_SIZE) {
+    cebr_enter();
+    for(uint32_t idx = start == 0 ? 1 : start; idx < next && idx < start + CHUNK_SIZE; idx++) {
+      cintern_slot_t *s = slot_at(t, idx);
+      cintern_id_t id = __atomic_load_n(&(s->id), __ATOMIC_ACQUIRE);
+      char *name;
+      void *value;
+      if(read_slot(t, id, &name, &value)) {
+        cb(id, name, value, ud);
+      }
+    }
+    cebr_exit();
+  }
+  return 0;
+}
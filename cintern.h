@@ -0,0 +1,163 @@
+/**
+ *  \file cintern.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Tabella concorrente di nomi internati
+ * Associa ad ogni nome inserito un identificatore intero compatto, e ad ogni
+ * identificatore un valore. Le strutture che fanno riferimento ad un nome
+ * possono quindi memorizzarne e confrontarne solo l'identificatore, e
+ * convertirlo in stringa solo quando serve, con un accesso diretto ad un
+ * vettore invece che con una ricerca per nome.
+ *
+ * Gli identificatori sono composti da un indice e da una generazione: quando
+ * un nome viene rimosso il suo indice viene riutilizzato con una generazione
+ * diversa, per cui un identificatore rimasto in uso dopo la rimozione del suo
+ * nome non ne identifica mai un altro, ma viene semplicemente riconosciuto
+ * come non più valido. Gli indici liberati vengono riutilizzati nell'ordine
+ * in cui sono stati liberati, finchè non hanno esaurito le generazioni:
+ * dopo di che non vengono più riutilizzati.
+ *
+ * Le letture, per nome o per identificatore, non acquisiscono alcun lock:
+ * le callback vengono eseguite all'interno di una sezione critica di
+ * \ref cebr_enter. Inserimenti e rimozioni sono serializzati da un mutex.
+ * I valori rimossi possono essere ancora in uso da letture concorrenti, e
+ * vanno deallocati tramite \ref cebr_retire.
+ */
+
+#ifndef CINTERN_H
+#define CINTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identificatore di un nome internato
+typedef uint32_t cintern_id_t;
+
+/// Identificatore che non corrisponde ad alcun nome
+#define CINTERN_NONE ((cintern_id_t)0)
+
+/// Tabella di nomi internati
+typedef struct cintern cintern_t;
+
+/**
+ * \brief Tipo della funzione di callback che viene chiamata quando si
+ *        ottiene un elemento dalla tabella
+ *
+ * \param id L'identificatore dell'elemento, \ref CINTERN_NONE se non esiste
+ * \param name Il nome dell'elemento. Se l'elemento non esiste, è il nome
+ *             cercato oppure NULL se è stato cercato un identificatore
+ * \param value Il valore dell'elemento, NULL se non esiste
+ * \param ud Dati arbitrari passati dall'utente
+ */
+typedef void(cintern_get_callback)(cintern_id_t id, const char *name, void *value, void *ud);
+
+/**
+ * \brief Tipo della funzione di callback che dealloca i valori rimasti
+ *        nella tabella alla sua distruzione
+ */
+typedef void(cintern_deinitializer)(void *value);
+
+/**
+ * \brief Inizializza una tabella di nomi internati
+ *
+ * \param capacity Numero di nomi previsti. La tabella cresce comunque in
+ *                 base al numero di nomi inseriti
+ * \return cintern_t* La tabella, NULL ed errno impostato in caso di errore
+ */
+cintern_t *cintern_init(size_t capacity);
+
+/**
+ * \brief Dealloca una tabella di nomi internati
+ *
+ * \param t La tabella da deallocare
+ * \param cb Funzione da chiamare sui valori ancora presenti (opzionale)
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cintern_deinit(cintern_t *t, cintern_deinitializer *cb);
+
+/**
+ * \brief Inserisce un nome nella tabella, se non è già presente
+ *
+ * \param t La tabella
+ * \param name Il nome da inserire
+ * \param value Il valore da associare al nome, diverso da NULL
+ * \param id Se non NULL, viene impostato all'identificatore del nome
+ *           inserito o di quello già presente
+ * \return int 0 se il nome è stato inserito, 1 se era già presente,
+ *             -1 ed errno impostato in caso di errore
+ */
+int cintern_add(cintern_t *t, const char *name, void *value, cintern_id_t *id);
+
+/**
+ * \brief Rimuove un nome dalla tabella. Il suo identificatore non sarà più
+ *        valido
+ *
+ * \param t La tabella
+ * \param name Il nome da rimuovere
+ * \param oldValue Se non NULL, viene impostato al valore rimosso, NULL se
+ *                 il nome non era presente
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cintern_remove(cintern_t *t, const char *name, void **oldValue);
+
+/**
+ * \brief Restituisce l'identificatore di un nome
+ *
+ * \param t La tabella
+ * \param name Il nome da cercare
+ * \return cintern_id_t L'identificatore, \ref CINTERN_NONE se il nome non è presente
+ */
+cintern_id_t cintern_find(cintern_t *t, const char *name);
+
+/**
+ * \brief Ottiene l'elemento con un dato identificatore
+ *
+ * \param t La tabella
+ * \param id L'identificatore da cercare
+ * \param cb Funzione chiamata con l'elemento trovato. Viene eseguita senza
+ *           lock, e può essere eseguita in parallelo per lo stesso elemento
+ * \param ud Dati da passare alla callback
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cintern_get(cintern_t *t, cintern_id_t id, cintern_get_callback *cb, void *ud);
+
+/**
+ * \brief Ottiene l'elemento con un dato nome
+ *
+ * \param t La tabella
+ * \param name Il nome da cercare
+ * \param cb Funzione chiamata con l'elemento trovato, come in \ref cintern_get
+ * \param ud Dati da passare alla callback
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cintern_lookup(cintern_t *t, const char *name, cintern_get_callback *cb, void *ud);
+
+/**
+ * \brief Copia il nome associato ad un identificatore
+ *
+ * \param t La tabella
+ * \param id L'identificatore
+ * \param buf Dove copiare il nome, terminato da '\\0'
+ * \param size Dimensione di \p buf. I nomi più lunghi vengono troncati
+ * \return int 1 se l'identificatore è valido, 0 altrimenti
+ */
+int cintern_name(cintern_t *t, cintern_id_t id, char *buf, size_t size);
+
+/**
+ * \brief Chiama una funzione su tutti gli elementi della tabella
+ *
+ * La tabella non viene bloccata: un elemento presente per tutta la durata
+ * della scansione viene visitato esattamente una volta, mentre quelli
+ * inseriti o rimossi nel frattempo possono essere visitati o meno.
+ *
+ * \param t La tabella
+ * \param cb Funzione chiamata su ogni elemento, come in \ref cintern_get
+ * \param ud Dati da passare alla callback
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int cintern_get_all(cintern_t *t, cintern_get_callback *cb, void *ud);
+
+#endif /* CINTERN_H */
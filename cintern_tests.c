@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cintern.h"
+#include "cebr.h"
+
+#define STABLE 500
+#define WRITERS 4
+#define ROUNDS 20000
+
+/* Ogni valore contiene il proprio nome, in modo da verificare che nome e
+   valore letti appartengano sempre allo stesso elemento */
+struct value {
+  char name[32];
+};
+
+cintern_t *t;
+cintern_id_t stable_ids[STABLE];
+int done = 0;
+long freed = 0;
+
+void free_value(void *ptr) {
+  __atomic_add_fetch(&freed, 1, __ATOMIC_RELAXED);
+  free(ptr);
+}
+
+struct value *make_value(const char *name) {
+  struct value *v = malloc(sizeof(struct value));
+  strcpy(v->name, name);
+  return v;
+}
+
+void check_cb(cintern_id_t id, const char *name, void *value, void *ud) {
+  if(id == CINTERN_NONE) {
+    assert(value == NULL);
+    return;
+  }
+  assert(strcmp(name, ((struct value*)value)->name) == 0);
+  if(ud != NULL) *(int*)ud = 1;
+}
+
+void count_cb(cintern_id_t id, const char *name, void *value, void *ud) {
+  assert(strcmp(name, ((struct value*)value)->name) == 0);
+  if(strncmp(name, "fisso ", 6) == 0) {
+    int i = atoi(name + 6);
+    assert(stable_ids[i] == id);
+    ((int*)ud)[i]++;
+  }
+}
+
+void *writer(void *ud) {
+  int w = *(int*)ud;
+  char name[32];
+
+  /* Inserisce e rimuove continuamente nomi, riutilizzando gli slot */
+  for(int i = 0; i < ROUNDS; i++) {
+    sprintf(name, "temp %d-%d", w, i % 50);
+    cintern_id_t id;
+    struct value *v = make_value(name);
+    int res = cintern_add(t, name, v, &id);
+    assert(res == 0 || res == 1);
+    if(res == 1) {
+      free(v);
+      void *old;
+      assert(cintern_remove(t, name, &old) == 0);
+      assert(old != NULL);
+      assert(cebr_retire(old, free_value) == 0);
+    }
+  }
+  return NULL;
+}
+
+void *reader(void *ud) {
+  int seen[STABLE];
+  uint32_t r = 1;
+
+  while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+    for(int i = 0; i < STABLE; i++) {
+      int found = 0;
+      assert(cintern_get(t, stable_ids[i], check_cb, &found) == 0);
+      assert(found);
+    }
+
+    /* Identificatori arbitrari non devono mai restituire elementi
+       incoerenti */
+    for(int i = 0; i < 1000; i++) {
+      r = r * 1103515245 + 12345;
+      assert(cintern_get(t, r % 4096, check_cb, NULL) == 0);
+    }
+
+    memset(seen, 0, sizeof(seen));
+    assert(cintern_get_all(t, count_cb, seen) == 0);
+    for(int i = 0; i < STABLE; i++) {
+      assert(seen[i] == 1);
+    }
+  }
+  return NULL;
+}
+
+int main(void) {
+  t = cintern_init(0);
+  assert(t != NULL);
+
+  char name[32];
+  char buf[32];
+
+  /* Inserimento e ricerca */
+  cintern_id_t a, b;
+  assert(cintern_add(t, "alice", make_value("alice"), &a) == 0);
+  assert(a != CINTERN_NONE);
+  struct value *dup = make_value("alice");
+  assert(cintern_add(t, "alice", dup, &b) == 1);
+  assert(a == b);
+  free(dup);
+  assert(cintern_find(t, "alice") == a);
+  assert(cintern_find(t, "bob") == CINTERN_NONE);
+  assert(cintern_name(t, a, buf, sizeof(buf)) == 1);
+  assert(strcmp(buf, "alice") == 0);
+  assert(cintern_name(t, a, buf, 3) == 1);
+  assert(strcmp(buf, "al") == 0);
+  int found = 0;
+  assert(cintern_lookup(t, "alice", check_cb, &found) == 0);
+  assert(found);
+
+  /* Dopo la rimozione l'identificatore non è più valido, anche se lo
+     slot viene riutilizzato */
+  void *old;
+  assert(cintern_remove(t, "alice", &old) == 0);
+  assert(old != NULL);
+  free(old);
+  assert(cintern_remove(t, "alice", &old) == 0);
+  assert(old == NULL);
+  assert(cintern_name(t, a, buf, sizeof(buf)) == 0);
+  assert(cintern_add(t, "alice", make_value("alice"), &b) == 0);
+  assert(a != b);
+  assert(cintern_name(t, a, buf, sizeof(buf)) == 0);
+  found = 0;
+  assert(cintern_get(t, a, check_cb, &found) == 0);
+  assert(!found);
+
+  /* Uno slot riutilizzato più volte di quante ne distingua la generazione
+     non restituisce mai un identificatore già assegnato */
+  cintern_id_t first;
+  assert(cintern_add(t, "ciclo", make_value("ciclo"), &first) == 0);
+  assert(cintern_remove(t, "ciclo", &old) == 0);
+  free(old);
+  for(int i = 0; i < 1000; i++) {
+    cintern_id_t c;
+    assert(cintern_add(t, "ciclo", make_value("ciclo"), &c) == 0);
+    assert(c != first);
+    assert(cintern_name(t, first, buf, sizeof(buf)) == 0);
+    assert(cintern_remove(t, "ciclo", &old) == 0);
+    free(old);
+  }
+
+  /* Letture senza lock in parallelo con inserimenti e rimozioni */
+  for(int i = 0; i < STABLE; i++) {
+    sprintf(name, "fisso %d", i);
+    assert(cintern_add(t, name, make_value(name), stable_ids + i) == 0);
+  }
+
+  pthread_t readers[2], writers[WRITERS];
+  int ids[WRITERS];
+  for(int i = 0; i < 2; i++) {
+    pthread_create(readers + i, NULL, reader, NULL);
+  }
+  for(int i = 0; i < WRITERS; i++) {
+    ids[i] = i;
+    pthread_create(writers + i, NULL, writer, ids + i);
+  }
+  for(int i = 0; i < WRITERS; i++) {
+    pthread_join(writers[i], NULL);
+  }
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  for(int i = 0; i < 2; i++) {
+    pthread_join(readers[i], NULL);
+  }
+
+  for(int i = 0; i < STABLE; i++) {
+    sprintf(name, "fisso %d", i);
+    assert(cintern_find(t, name) == stable_ids[i]);
+  }
+
+  /* Ogni nome temporaneo è stato inserito e rimosso lo stesso numero di
+     volte, e ogni valore rimosso è stato deallocato una sola volta */
+  cebr_flush();
+  long removed = freed;
+  freed = 0;
+  assert(cintern_deinit(t, free_value) == 0);
+  assert(freed == STABLE + 1);
+  assert(removed == WRITERS * ROUNDS / 2);
+  cebr_flush();
+  return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ *  \file cmessage.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cmessage.h"
+#include "cslab.h"
+
+cmessage_t *cmessage_create(const message_t *msg) {
+  if(msg == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  size_t len = msg->data.buf != NULL ? msg->data.hdr.len : 0;
+  cmessage_t *m = cslab_alloc(sizeof(cmessage_t) + len);
+  if(m == NULL) return NULL;
+
+  m->msg = *msg;
+  m->msg.data.buf = NULL;
+  if(len > 0) {
+    m->msg.data.buf = (char*)(m + 1);
+    memcpy(m->msg.data.buf, msg->data.buf, len);
+  }
+  m->refs = 1;
+  return m;
+}
+
+cmessage_t *cmessage_ref(cmessage_t *m) {
+  __atomic_add_fetch(&(m->refs), 1, __ATOMIC_RELAXED);
+  return m;
+}
+
+void cmessage_unref(cmessage_t *m) {
+  if(m == NULL) return;
+
+  /* Le scritture fatte dagli altri utilizzatori devono essere visibili
+     prima della deallocazione */
+  if(__atomic_sub_fetch(&(m->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+    cslab_free(m);
+  }
+}
@@ -0,0 +1,56 @@
+/**
+ *  \file cmessage.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Messaggi immutabili condivisi
+ * Un messaggio inviato a più destinatari viene copiato una sola volta, e la
+ * stessa copia viene condivisa da tutte le cronologie e le code di uscita in
+ * cui compare. Ogni utilizzatore ne mantiene un riferimento, e il messaggio
+ * viene deallocato quando l'ultimo riferimento viene rilasciato.
+ *
+ * Dopo la creazione il messaggio non può essere modificato, per cui può
+ * essere letto da più thread senza sincronizzazione. Chi deve inviarlo con
+ * un header diverso (ad esempio con un'altra operazione) ne copia l'header.
+ */
+
+#ifndef CMESSAGE_H
+#define CMESSAGE_H
+
+#include "message.h"
+
+/**
+ * \brief Messaggio condiviso
+ */
+typedef struct cmessage {
+  message_t msg; ///< Il messaggio. Il buffer dei dati fa parte della stessa allocazione
+  long refs; ///< Numero di riferimenti (accesso atomico)
+} cmessage_t;
+
+/**
+ * \brief Crea un messaggio condiviso copiando \p msg e il suo buffer dei dati
+ *
+ * \param msg Il messaggio da copiare
+ * \return cmessage_t* Il messaggio creato, con un riferimento.
+ *                     NULL ed errno impostato in caso di errore
+ */
+cmessage_t *cmessage_create(const message_t *msg);
+
+/**
+ * \brief Acquisisce un riferimento ad un messaggio
+ *
+ * \param m Il messaggio
+ * \return cmessage_t* Sempre \p m
+ */
+cmessage_t *cmessage_ref(cmessage_t *m);
+
+/**
+ * \brief Rilascia un riferimento ad un messaggio, deallocandolo se era l'ultimo
+ *
+ * \param m Il messaggio (può essere NULL)
+ */
+void cmessage_unref(cmessage_t *m);
+
+#endif /* CMESSAGE_H */
@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cmessage.h"
+
+#define THREADS 8
+#define ROUNDS 100000
+
+void *func(void *ud) {
+  cmessage_t *m = (cmessage_t*)ud;
+  for(int i = 0; i < ROUNDS; i++) {
+    cmessage_unref(cmessage_ref(m));
+  }
+  /* Rilascia il riferimento acquisito dal thread principale */
+  cmessage_unref(m);
+  return NULL;
+}
+
+int main(void) {
+  char text[] = "ciao";
+  message_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.hdr.op = POSTTXT_OP;
+  strcpy(msg.hdr.sender, "pippo");
+  msg.data.hdr.len = sizeof(text);
+  msg.data.buf = text;
+
+  /* Il messaggio e il suo buffer vengono copiati */
+  cmessage_t *m = cmessage_create(&msg);
+  assert(m != NULL && m->refs == 1);
+  assert(m->msg.data.buf != text);
+  text[0] = 'x';
+  assert(strcmp(m->msg.data.buf, "ciao") == 0);
+  assert(strcmp(m->msg.hdr.sender, "pippo") == 0);
+
+  /* Un messaggio senza dati non ha buffer */
+  msg.data.buf = NULL;
+  cmessage_t *empty = cmessage_create(&msg);
+  assert(empty != NULL && empty->msg.data.buf == NULL);
+  cmessage_unref(empty);
+
+  pthread_t threads[THREADS];
+  for(int i = 0; i < THREADS; i++) {
+    pthread_create(threads + i, NULL, func, cmessage_ref(m));
+  }
+  for(int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  assert(m->refs == 1);
+  cmessage_unref(m);
+  return 0;
+}
@@ -4,11 +4,18 @@
  * 
  *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
  *     originale dell'autore
+ * 
+ *  I messaggi composti da più parti (header, header dei dati e corpo) vengono
+ *  trasferiti con una sola chiamata di sistema tramite readv/writev.
+ *  Queste funzioni sono bloccanti e vengono usate dal client: il server legge
+ *  le richieste tramite msgbuf e invia le risposte tramite outqueue, e le usa
+ *  solo per rifiutare le connessioni in eccesso.
  */
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <errno.h>
@@ -18,6 +25,9 @@
 #include "connections.h"
 #include "errman.h"
 
+/// Numero massimo di buffer trasferiti da una singola readv/writev
+#define MAX_IOV 1024
+
 /**
  * \brief Legge esattamente len byte dal descrittore fd
  * 
@@ -77,6 +87,57 @@ static ssize_t writen(long fd, void *buf, size_t len) {
   return 1;
 }
 
+/**
+ * \brief Avanza un vettore di buffer di \p len byte già trasferiti
+ * 
+ * \param iov Il vettore, viene spostato al primo buffer non completato
+ * \param n Il numero di buffer, viene aggiornato di conseguenza
+ * \param len Il numero di byte trasferiti
+ */
+static void iov_advance(struct iovec **iov, int *n, size_t len) {
+  while(*n > 0 && len >= (*iov)->iov_len) {
+    len -= (*iov)->iov_len;
+    (*iov)++;
+    (*n)--;
+  }
+
+  if(*n > 0) {
+    (*iov)->iov_base = (uint8_t*)(*iov)->iov_base + len;
+    (*iov)->iov_len -= len;
+  }
+}
+
+/**
+ * \brief Legge o scrive esattamente il contenuto di più buffer tramite readv/writev
+ * 
+ * I buffer NULL vengono saltati, come in \ref readn e \ref writen.
+ * Il vettore \p iov viene modificato.
+ * 
+ * \param fd Il descrittore su cui operare
+ * \param iov I buffer da trasferire
+ * \param n Il numero di buffer
+ * \param write 1 per scrivere su \p fd, 0 per leggere
+ * \return int 1 in caso di successo, -1 in caso di errore,
+ *             0 se il descrittore è stato chiuso prima del trasferimento completo
+ */
+static int transferv(long fd, struct iovec *iov, int n, int write) {
+  for(int i = 0; i < n; i++) {
+    if(iov[i].iov_base == NULL) iov[i].iov_len = 0;
+  }
+  iov_advance(&iov, &n, 0);
+
+  while(n > 0) {
+    int cnt = n > MAX_IOV ? MAX_IOV : n;
+    ssize_t r = write ? writev(fd, iov, cnt) : readv(fd, iov, cnt);
+    if(r < 0 && errno == EINTR) continue;
+    if(r == 0) return 0;
+    if(r < 0) return -1;
+
+    iov_advance(&iov, &n, r);
+  }
+  return 1;
+}
+
 int readHeader(long fd, message_hdr_t *hdr) {
   return readn(fd, (void*)hdr, sizeof(message_hdr_t));
 }
@@ -85,65 +146,70 @@ int readDataHeader(long fd, message_data_hdr_t *datahdr) {
   return readn(fd, (void*)datahdr, sizeof(message_data_hdr_t));
 }
 
+/**
+ * \brief Legge il corpo di un messaggio di cui è già stato letto l'header dei dati
+ * 
+ * \param fd Il descrittore da cui leggere
+ * \param data La parte dati del messaggio, con l'header già letto
+ * \return int Vedi readn
+ */
+static int readBody(long fd, message_data_t *data) {
+  void *buf = calloc(data->hdr.len, sizeof(char));
+  if(buf == NULL) {
+    return -1;
+  }
+
+  int res;
+  if((res = readn(fd, buf, data->hdr.len)) > 0) {
+    data->buf = buf;
+  } else {
+    free(buf);
+  }
+  return res;
+}
+
 int readData(long fd, message_data_t *data) {
   int res;
   if((res = readDataHeader(fd, &(data->hdr))) > 0) {
-    void *buf = calloc(data->hdr.len, sizeof(char));
-    if(buf == NULL) {
-      return -1;
-    }
-
-    if((res = readn(fd, buf, data->hdr.len)) > 0) {
-      data->buf = buf;
-    } else {
-      free(buf);
-    }
-    return res;
+    return readBody(fd, data);
   } else {
     return res;
   }
 }
 
 int readMsg(long fd, message_t *msg) {
+  /* I due header hanno lunghezza fissa e vengono letti insieme */
+  struct iovec parts[2] = {
+    { &(msg->hdr), sizeof(message_hdr_t) },
+    { &(msg->data.hdr), sizeof(message_data_hdr_t) }
+  };
+
   int res;
-  if((res = readHeader(fd, &(msg->hdr))) > 0 &&
-     (res = readData(fd, &(msg->data))) > 0) {
-    return res;
+  if((res = transferv(fd, parts, 2, 0)) > 0) {
+    return readBody(fd, &(msg->data));
   }
   return res;
 }
 
-/**
- * \brief Invia un header dati ad un descrittore
- * 
- * \param fd Il descrittore a cui inviare l'header
- * \param datahdr L'header da inviare
- * \return int Vedi writen
- */
-static int sendDataHeader(long fd, message_data_hdr_t *datahdr) {
-  return writen(fd, (void*)datahdr, sizeof(message_data_hdr_t));
-}
-
 int sendHeader(long fd, message_hdr_t *hdr) {
   return writen(fd, (void*)hdr, sizeof(message_hdr_t));
 }
 
 int sendData(long fd, message_data_t *data) {
-  int res = sendDataHeader(fd, &(data->hdr));
-  if(res > 0) {
-    return writen(fd, data->buf, data->hdr.len);
-  } else {
-    return res;
-  }
+  struct iovec parts[2] = {
+    { &(data->hdr), sizeof(message_data_hdr_t) },
+    { data->buf, data->hdr.len }
+  };
+  return transferv(fd, parts, 2, 1);
 }
 
 int sendRequest(long fd, message_t *msg) {
-  int res = sendHeader(fd, &(msg->hdr));
-  if(res > 0) {
-    return sendData(fd, &(msg->data));
-  } else {
-    return res;
-  }
+  struct iovec parts[3] = {
+    { &(msg->hdr), sizeof(message_hdr_t) },
+    { &(msg->data.hdr), sizeof(message_data_hdr_t) },
+    { msg->data.buf, msg->data.hdr.len }
+  };
+  return transferv(fd, parts, 3, 1);
 }
 
 int openConnection(char* path, unsigned int ntimes, unsigned int secs) {
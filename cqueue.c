@@ -10,6 +10,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include "cqueue.h"
+#include "cslab.h"
 
 #define CHECK_RET if(ret != 0) { \
                     errno = ret; \
@@ -48,7 +49,7 @@ static void freeList(node_t *n, cqueue_deinitializer cb) {
     n->v = NULL;
   }
 
-  free(n);
+  cslab_free(n);
 }
 
 cqueue_t *cqueue_init() {
@@ -106,7 +107,7 @@ int cqueue_deinit(cqueue_t *cq, cqueue_deinitializer cb) {
 static int cqueue_push_nolock(cqueue_t *cq, void *v) {
   if(cq->tail == NULL) {
     /* Caso in cui la coda sia ancora vuota */
-    cq->head = calloc(1, sizeof(node_t));
+    cq->head = cslab_alloc(sizeof(node_t));
     if(cq->head == NULL) {
       return -1;
     }
@@ -116,7 +117,7 @@ static int cqueue_push_nolock(cqueue_t *cq, void *v) {
     cq->size = 1;
   } else {
     /* Caso in cui la coda abbia più di un elemento */
-    node_t *newElem = calloc(1, sizeof(node_t));
+    node_t *newElem = cslab_alloc(sizeof(node_t));
     if(newElem == NULL) {
       return -1;
     }
@@ -165,7 +166,7 @@ static int cqueue_pop_nolock(cqueue_t *cq, void **elem) {
   if(cq->head == cq->tail) {
     /* Caso in cui è presente un solo
       elemento nella coda */
-    free(cq->head);
+    cslab_free(cq->head);
     cq->head = NULL;
     cq->tail = NULL;
     cq->size = 0;
@@ -173,7 +174,7 @@ static int cqueue_pop_nolock(cqueue_t *cq, void **elem) {
     /* Caso standard - la coda
       ha più di un elemento */
     node_t *next = cq->head->next;
-    free(cq->head);
+    cslab_free(cq->head);
     cq->head = next;
     cq->size--;
   }
@@ -0,0 +1,209 @@
+/**
+ *  \file cring.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "cring.h"
+
+/// Dimensione di una linea di cache
+#define CACHE_LINE 64
+
+/**
+ * \brief Cella della coda
+ *
+ * Se \ref seq è uguale alla posizione di inserimento la cella è libera,
+ * se è uguale alla posizione di inserimento + 1 contiene un elemento.
+ */
+typedef struct {
+  size_t seq; ///< Numero di sequenza della cella (accesso atomico)
+  long value; ///< Valore memorizzato
+} cell_t;
+
+/**
+ * \brief Una coda concorrente limitata
+ *
+ * Gli indici modificati da produttori e consumatori sono posti su linee di
+ * cache distinte, in modo che le due parti non si contendano la stessa linea.
+ */
+struct cring {
+  cell_t *cells; ///< Celle della coda
+  size_t mask; ///< Capienza - 1
+  char pad0[CACHE_LINE - sizeof(cell_t*) - sizeof(size_t)];
+  size_t enqueue_pos; ///< Prossima posizione di inserimento (accesso atomico)
+  char pad1[CACHE_LINE - sizeof(size_t)];
+  size_t dequeue_pos; ///< Prossima posizione di estrazione (accesso atomico)
+  char pad2[CACHE_LINE - sizeof(size_t)];
+  uint32_t futex_seq; ///< Incrementato ad ogni inserimento, usato come futex
+  uint32_t waiters; ///< Numero di consumatori in attesa (accesso atomico)
+};
+
+static int futex_wait(uint32_t *addr, uint32_t expected) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static int futex_wake(uint32_t *addr, int n) {
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+cring_t *cring_init(size_t capacity) {
+  if(capacity < 2) capacity = 2;
+
+  size_t len = 1;
+  while(len < capacity) len <<= 1;
+
+  cring_t *ring;
+  int ret = posix_memalign((void**)&ring, CACHE_LINE, sizeof(cring_t));
+  if(ret != 0) {
+    errno = ret;
+    return NULL;
+  }
+
+  ring->cells = calloc(len, sizeof(cell_t));
+  if(ring->cells == NULL) {
+    free(ring);
+    return NULL;
+  }
+
+  for(size_t i = 0; i < len; i++) {
+    ring->cells[i].seq = i;
+  }
+  ring->mask = len - 1;
+  ring->enqueue_pos = 0;
+  ring->dequeue_pos = 0;
+  ring->futex_seq = 0;
+  ring->waiters = 0;
+
+  return ring;
+}
+
+int cring_deinit(cring_t *ring) {
+  if(ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  free(ring->cells);
+  free(ring);
+  return 0;
+}
+
+int cring_push(cring_t *ring, long v) {
+  if(ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cell_t *cell;
+  size_t pos = __atomic_load_n(&(ring->enqueue_pos), __ATOMIC_RELAXED);
+  for(;;) {
+    cell = &(ring->cells[pos & ring->mask]);
+    size_t seq = __atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if(dif == 0) {
+      if(__atomic_compare_exchange_n(&(ring->enqueue_pos), &pos, pos + 1, 1,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if(dif < 0) {
+      /* La cella contiene ancora un elemento di un giro precedente */
+      errno = EAGAIN;
+      return -1;
+    } else {
+      pos = __atomic_load_n(&(ring->enqueue_pos), __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->value = v;
+  __atomic_store_n(&(cell->seq), pos + 1, __ATOMIC_RELEASE);
+
+  /* L'incremento deve precedere la lettura di waiters: un consumatore
+     che si è registrato dopo vedrà il nuovo elemento o il futex cambiato */
+  __atomic_add_fetch(&(ring->futex_seq), 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&(ring->waiters), __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&(ring->futex_seq), 1);
+  }
+
+  return 0;
+}
+
+int cring_try_pop(cring_t *ring, long *v) {
+  if(ring == NULL || v == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  cell_t *cell;
+  size_t pos = __atomic_load_n(&(ring->dequeue_pos), __ATOMIC_RELAXED);
+  for(;;) {
+    cell = &(ring->cells[pos & ring->mask]);
+    size_t seq = __atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE);
+    intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+    if(dif == 0) {
+      if(__atomic_compare_exchange_n(&(ring->dequeue_pos), &pos, pos + 1, 1,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if(dif < 0) {
+      /* La cella non è ancora stata riempita */
+      errno = EAGAIN;
+      return -1;
+    } else {
+      pos = __atomic_load_n(&(ring->dequeue_pos), __ATOMIC_RELAXED);
+    }
+  }
+
+  *v = cell->value;
+  __atomic_store_n(&(cell->seq), pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+int cring_pop(cring_t *ring, long *v) {
+  if(ring == NULL || v == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(;;) {
+    if(cring_try_pop(ring, v) == 0) return 0;
+
+    /* Si registra come consumatore in attesa prima di leggere il futex
+       e di ricontrollare la coda, in modo da non perdere risvegli */
+    __atomic_add_fetch(&(ring->waiters), 1, __ATOMIC_SEQ_CST);
+    uint32_t seq = __atomic_load_n(&(ring->futex_seq), __ATOMIC_SEQ_CST);
+
+    if(cring_try_pop(ring, v) == 0) {
+      __atomic_sub_fetch(&(ring->waiters), 1, __ATOMIC_SEQ_CST);
+      return 0;
+    }
+
+    int ret = futex_wait(&(ring->futex_seq), seq);
+    __atomic_sub_fetch(&(ring->waiters), 1, __ATOMIC_SEQ_CST);
+    if(ret == -1 && errno != EAGAIN && errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+int cring_size(cring_t *ring) {
+  if(ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size_t deq = __atomic_load_n(&(ring->dequeue_pos), __ATOMIC_ACQUIRE);
+  size_t enq = __atomic_load_n(&(ring->enqueue_pos), __ATOMIC_ACQUIRE);
+
+  return enq > deq ? (int)(enq - deq) : 0;
+}
@@ -0,0 +1,88 @@
+/**
+ *  \file cring.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Coda concorrente limitata senza lock
+ * Consente di gestire una coda FIFO di interi fra più produttori e più
+ * consumatori senza allocazioni e senza mutex.
+ *
+ * Implementata tramite un buffer circolare in cui ogni cella ha un numero
+ * di sequenza che indica se è libera o occupata. L'attesa di elementi
+ * avviene tramite futex.
+ */
+
+#ifndef CRING_H
+#define CRING_H
+
+#include <sys/types.h>
+
+/// Coda concorrente limitata
+typedef struct cring cring_t;
+
+/**
+ * \brief Inizializza la coda
+ *
+ * \param capacity Numero minimo di elementi che la coda deve poter contenere.
+ *                 Viene arrotondato alla potenza di 2 successiva.
+ * \return cring_t* NULL se l'inizializzazione non ha avuto successo.
+ *                  Se si sono verificati errori viene impostato errno.
+ */
+cring_t *cring_init(size_t capacity);
+
+/**
+ * \brief Dealloca la coda
+ *
+ * \param ring La coda da deallocare
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Viene impostato errno se si sono verificati errori.
+ */
+int cring_deinit(cring_t *ring);
+
+/**
+ * \brief Inserisce un elemento nella coda e risveglia un eventuale
+ *        consumatore in attesa
+ *
+ * \param ring La coda in cui inserire l'elemento
+ * \param v L'elemento da inserire nella coda
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Se la coda è piena errno viene impostato a EAGAIN.
+ */
+int cring_push(cring_t *ring, long v);
+
+/**
+ * \brief Estrae un elemento dalla coda senza attendere
+ *
+ * \param ring La coda da cui estrarre
+ * \param v L'elemento estratto
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Se la coda è vuota errno viene impostato a EAGAIN.
+ */
+int cring_try_pop(cring_t *ring, long *v);
+
+/**
+ * \brief Estrae un elemento dalla coda.
+ * Se la coda è vuota, attende che venga inserito un elemento.
+ *
+ * \param ring La coda da cui estrarre
+ * \param v L'elemento estratto
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Viene impostato errno se si sono verificati errori.
+ */
+int cring_pop(cring_t *ring, long *v);
+
+/**
+ * \brief Ottiene il numero approssimativo di elementi nella coda
+ *
+ * Il valore può essere già superato al ritorno se altri thread
+ * stanno operando sulla coda.
+ *
+ * \param ring La coda di cui ottenere la lunghezza
+ * \return int >=0 se la chiamata ha avuto successo, -1 altrimenti.
+ *             Viene impostato errno se si sono verificati errori.
+ */
+int cring_size(cring_t *ring);
+
+#endif /* CRING_H */
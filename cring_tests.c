@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include "cring.h"
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define PER_PRODUCER 100000
+
+struct arg {
+  cring_t *ring;
+  long base;
+  long sum;
+};
+
+void *producer(void *ud) {
+  struct arg *a = (struct arg*)ud;
+  for(long i = 1; i <= PER_PRODUCER; i++) {
+    while(cring_push(a->ring, a->base + i) != 0) {
+      assert(errno == EAGAIN);
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+void *consumer(void *ud) {
+  struct arg *a = (struct arg*)ud;
+  long v;
+  for(;;) {
+    assert(cring_pop(a->ring, &v) == 0);
+    if(v == -1) return NULL;
+    a->sum += v;
+  }
+}
+
+int main(void) {
+  cring_t *ring = cring_init(5);
+  long v;
+
+  /* La capienza viene arrotondata a 8 */
+  for(long i = 0; i < 8; i++) {
+    assert(cring_push(ring, i) == 0);
+  }
+  assert(cring_push(ring, 8) == -1 && errno == EAGAIN);
+  assert(cring_size(ring) == 8);
+
+  for(long i = 0; i < 8; i++) {
+    assert(cring_try_pop(ring, &v) == 0);
+    assert(v == i);
+  }
+  assert(cring_try_pop(ring, &v) == -1 && errno == EAGAIN);
+  assert(cring_size(ring) == 0);
+  cring_deinit(ring);
+
+  /* Più produttori e più consumatori su una coda piccola */
+  ring = cring_init(64);
+  pthread_t prod[PRODUCERS], cons[CONSUMERS];
+  struct arg pargs[PRODUCERS], cargs[CONSUMERS];
+
+  for(int i = 0; i < CONSUMERS; i++) {
+    cargs[i].ring = ring;
+    cargs[i].sum = 0;
+    pthread_create(cons + i, NULL, consumer, cargs + i);
+  }
+  for(int i = 0; i < PRODUCERS; i++) {
+    pargs[i].ring = ring;
+    pargs[i].base = (long)i * PER_PRODUCER;
+    pthread_create(prod + i, NULL, producer, pargs + i);
+  }
+
+  for(int i = 0; i < PRODUCERS; i++) {
+    pthread_join(prod[i], NULL);
+  }
+  for(int i = 0; i < CONSUMERS; i++) {
+    while(cring_push(ring, -1) != 0) sched_yield();
+  }
+
+  long sum = 0;
+  for(int i = 0; i < CONSUMERS; i++) {
+    pthread_join(cons[i], NULL);
+    sum += cargs[i].sum;
+  }
+
+  long n = (long)PRODUCERS * PER_PRODUCER;
+  assert(sum == n * (n + 1) / 2);
+
+  cring_deinit(ring);
+  return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ *  \file csched.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "cring.h"
+#include "csched.h"
+
+/// Dimensione di una linea di cache
+#define CACHE_LINE 64
+
+/**
+ * \brief Uno scheduler con work stealing
+ */
+struct csched {
+  cring_t **queues; ///< Code dei worker
+  int nworkers; ///< Numero di worker
+  char pad0[CACHE_LINE - sizeof(cring_t**) - sizeof(int)];
+  uint32_t futex_seq; ///< Incrementato ad ogni inserimento, usato come futex
+  uint32_t waiters; ///< Numero di worker in attesa (accesso atomico)
+};
+
+static int futex_wait(uint32_t *addr, uint32_t expected) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static int futex_wake(uint32_t *addr, int n) {
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+csched_t *csched_init(int nworkers, size_t capacity) {
+  if(nworkers <= 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  csched_t *sched;
+  int ret = posix_memalign((void**)&sched, CACHE_LINE, sizeof(csched_t));
+  if(ret != 0) {
+    errno = ret;
+    return NULL;
+  }
+
+  sched->queues = calloc(nworkers, sizeof(cring_t*));
+  if(sched->queues == NULL) {
+    free(sched);
+    return NULL;
+  }
+
+  for(int i = 0; i < nworkers; i++) {
+    sched->queues[i] = cring_init(capacity);
+    if(sched->queues[i] == NULL) {
+      int err = errno;
+      for(int j = 0; j < i; j++) {
+        cring_deinit(sched->queues[j]);
+      }
+      free(sched->queues);
+      free(sched);
+      errno = err;
+      return NULL;
+    }
+  }
+
+  sched->nworkers = nworkers;
+  sched->futex_seq = 0;
+  sched->waiters = 0;
+
+  return sched;
+}
+
+int csched_deinit(csched_t *sched) {
+  if(sched == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(int i = 0; i < sched->nworkers; i++) {
+    cring_deinit(sched->queues[i]);
+  }
+  free(sched->queues);
+  free(sched);
+  return 0;
+}
+
+int csched_push(csched_t *sched, int worker, long v) {
+  if(sched == NULL || worker < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int pushed = 0;
+  for(int i = 0; i < sched->nworkers && !pushed; i++) {
+    int w = (worker + i) % sched->nworkers;
+    if(cring_push(sched->queues[w], v) == 0) {
+      pushed = 1;
+    } else if(errno != EAGAIN) {
+      return -1;
+    }
+  }
+
+  if(!pushed) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  /* L'incremento deve precedere la lettura di waiters: un worker
+     che si è registrato dopo vedrà il nuovo elemento o il futex cambiato */
+  __atomic_add_fetch(&(sched->futex_seq), 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&(sched->waiters), __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&(sched->futex_seq), 1);
+  }
+
+  return 0;
+}
+
+int csched_try_pop(csched_t *sched, int worker, long *v) {
+  if(sched == NULL || worker < 0 || v == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* La coda del worker viene controllata per prima, poi le altre a partire
+     dalla successiva, in modo che i worker non rubino tutti dalla stessa */
+  for(int i = 0; i < sched->nworkers; i++) {
+    int w = (worker + i) % sched->nworkers;
+    if(cring_try_pop(sched->queues[w], v) == 0) {
+      return 0;
+    } else if(errno != EAGAIN) {
+      return -1;
+    }
+  }
+
+  errno = EAGAIN;
+  return -1;
+}
+
+int csched_pop(csched_t *sched, int worker, long *v) {
+  for(;;) {
+    if(csched_try_pop(sched, worker, v) == 0) return 0;
+    if(errno != EAGAIN) return -1;
+
+    /* Si registra come worker in attesa prima di leggere il futex
+       e di ricontrollare le code, in modo da non perdere risvegli */
+    __atomic_add_fetch(&(sched->waiters), 1, __ATOMIC_SEQ_CST);
+    uint32_t seq = __atomic_load_n(&(sched->futex_seq), __ATOMIC_SEQ_CST);
+
+    if(csched_try_pop(sched, worker, v) == 0) {
+      __atomic_sub_fetch(&(sched->waiters), 1, __ATOMIC_SEQ_CST);
+      return 0;
+    }
+
+    int ret = futex_wait(&(sched->futex_seq), seq);
+    __atomic_sub_fetch(&(sched->waiters), 1, __ATOMIC_SEQ_CST);
+    if(ret == -1 && errno != EAGAIN && errno != EINTR) {
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/**
+ *  \file csched.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Scheduler con work stealing
+ * Distribuisce elementi (interi) fra un insieme di worker. Ogni worker ha la
+ * propria coda: un elemento viene inserito nella coda del worker indicato, e
+ * ogni worker estrae prima dalla propria coda e, se vuota, "ruba" dalle code
+ * degli altri worker.
+ *
+ * Implementato tramite una \ref cring_t per ogni worker. L'attesa di elementi
+ * avviene tramite un unico futex condiviso fra tutti i worker.
+ */
+
+#ifndef CSCHED_H
+#define CSCHED_H
+
+#include <sys/types.h>
+
+/// Scheduler con work stealing
+typedef struct csched csched_t;
+
+/**
+ * \brief Inizializza lo scheduler
+ *
+ * \param nworkers Numero di worker
+ * \param capacity Capienza minima della coda di ciascun worker
+ * \return csched_t* NULL se l'inizializzazione non ha avuto successo.
+ *                   Se si sono verificati errori viene impostato errno.
+ */
+csched_t *csched_init(int nworkers, size_t capacity);
+
+/**
+ * \brief Dealloca lo scheduler
+ *
+ * \param sched Lo scheduler da deallocare
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Viene impostato errno se si sono verificati errori.
+ */
+int csched_deinit(csched_t *sched);
+
+/**
+ * \brief Inserisce un elemento nella coda di un worker e risveglia un
+ *        eventuale worker in attesa
+ *
+ * Se la coda del worker è piena, l'elemento viene inserito nella prima
+ * coda disponibile.
+ *
+ * \param sched Lo scheduler in cui inserire l'elemento
+ * \param worker Il worker a cui è destinato l'elemento
+ * \param v L'elemento da inserire
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Se tutte le code sono piene errno viene impostato a EAGAIN.
+ */
+int csched_push(csched_t *sched, int worker, long v);
+
+/**
+ * \brief Estrae un elemento senza attendere, rubandolo agli altri worker
+ *        se la coda di \p worker è vuota
+ *
+ * \param sched Lo scheduler da cui estrarre
+ * \param worker Il worker che effettua l'estrazione
+ * \param v L'elemento estratto
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Se tutte le code sono vuote errno viene impostato a EAGAIN.
+ */
+int csched_try_pop(csched_t *sched, int worker, long *v);
+
+/**
+ * \brief Estrae un elemento come \ref csched_try_pop.
+ * Se tutte le code sono vuote, attende che venga inserito un elemento.
+ *
+ * \param sched Lo scheduler da cui estrarre
+ * \param worker Il worker che effettua l'estrazione
+ * \param v L'elemento estratto
+ * \return int 0 se la funzione ha avuto successo, -1 altrimenti.
+ *             Viene impostato errno se si sono verificati errori.
+ */
+int csched_pop(csched_t *sched, int worker, long *v);
+
+#endif /* CSCHED_H */
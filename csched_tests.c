@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include "csched.h"
+
+#define WORKERS 4
+#define ITEMS 200000
+
+struct arg {
+  csched_t *sched;
+  int id;
+  long sum;
+  long count;
+};
+
+void *worker(void *ud) {
+  struct arg *a = (struct arg*)ud;
+  long v;
+  for(;;) {
+    assert(csched_pop(a->sched, a->id, &v) == 0);
+    if(v == -1) {
+      /* Il segnale di uscita viene reimmesso per gli altri worker */
+      assert(csched_push(a->sched, a->id, v) == 0);
+      return NULL;
+    }
+    a->sum += v;
+    a->count++;
+  }
+}
+
+int main(void) {
+  csched_t *sched = csched_init(2, 4);
+  long v;
+
+  /* Un worker estrae prima dalla propria coda */
+  assert(csched_push(sched, 0, 1) == 0);
+  assert(csched_push(sched, 1, 2) == 0);
+  assert(csched_try_pop(sched, 1, &v) == 0 && v == 2);
+  /* e poi ruba dalle altre */
+  assert(csched_try_pop(sched, 1, &v) == 0 && v == 1);
+  assert(csched_try_pop(sched, 0, &v) == -1 && errno == EAGAIN);
+
+  /* Se la coda del worker è piena si usa quella di un altro */
+  for(long i = 0; i < 8; i++) {
+    assert(csched_push(sched, 0, i) == 0);
+  }
+  assert(csched_push(sched, 0, 8) == -1 && errno == EAGAIN);
+  for(long i = 0; i < 8; i++) {
+    assert(csched_try_pop(sched, 1, &v) == 0);
+  }
+  csched_deinit(sched);
+
+  /* Tutti gli elementi sono destinati al worker 0, gli altri rubano */
+  sched = csched_init(WORKERS, 64);
+  pthread_t threads[WORKERS];
+  struct arg args[WORKERS];
+
+  for(int i = 0; i < WORKERS; i++) {
+    args[i].sched = sched;
+    args[i].id = i;
+    args[i].sum = 0;
+    args[i].count = 0;
+    pthread_create(threads + i, NULL, worker, args + i);
+  }
+
+  for(long i = 1; i <= ITEMS; i++) {
+    while(csched_push(sched, 0, i) != 0) {
+      assert(errno == EAGAIN);
+      sched_yield();
+    }
+  }
+  while(csched_push(sched, 0, -1) != 0) sched_yield();
+
+  long sum = 0, count = 0;
+  for(int i = 0; i < WORKERS; i++) {
+    pthread_join(threads[i], NULL);
+    sum += args[i].sum;
+    count += args[i].count;
+  }
+
+  assert(count == ITEMS);
+  assert(sum == (long)ITEMS * (ITEMS + 1) / 2);
+
+  csched_deinit(sched);
+  return 0;
+}
@@ -0,0 +1,300 @@
+/**
+ *  \file cslab.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "cslab.h"
+
+/// Logaritmo della classe più piccola
+#define MIN_SHIFT 4
+
+/// Logaritmo della classe più grande, pari a \ref CSLAB_MAX_SIZE
+#define MAX_SHIFT 16
+
+/// Numero di classi: ogni potenza di 2 e il suo multiplo per 1.5
+#define NUM_CLASSES ((MAX_SHIFT - MIN_SHIFT) * 2 + 1)
+
+/// Classe degli oggetti allocati direttamente con malloc
+#define LARGE_CLASS NUM_CLASSES
+
+/// Memoria che la lista di un thread può conservare per ogni classe
+#define CACHE_BYTES (256 * 1024)
+
+/// Numero minimo di oggetti che la lista di un thread può conservare
+#define MIN_CACHED 8
+
+/// Numero massimo di oggetti che la lista di un thread può conservare
+#define MAX_CACHED 256
+
+/// Rapporto fra il limite del deposito e quello della lista di un thread
+#define DEPOT_FACTOR 8
+
+/**
+ * \brief Intestazione di ogni oggetto, allineata come le allocazioni di malloc
+ */
+typedef union header {
+  size_t cls; ///< Classe dell'oggetto
+  long double align_ld; ///< Allineamento
+  void *align_p; ///< Allineamento
+} header_t;
+
+/**
+ * \brief Oggetto libero, memorizzato al posto dell'intestazione
+ */
+typedef struct free_obj {
+  struct free_obj *next; ///< Oggetto libero successivo
+} free_obj_t;
+
+/**
+ * \brief Lista di oggetti liberi di una classe
+ */
+typedef struct {
+  free_obj_t *head; ///< Primo oggetto
+  size_t n; ///< Numero di oggetti
+} free_list_t;
+
+/**
+ * \brief Liste di oggetti liberi di un thread
+ */
+typedef struct {
+  free_list_t lists[NUM_CLASSES]; ///< Una lista per classe
+} thread_cache_t;
+
+/**
+ * \brief Deposito globale di oggetti liberi di una classe
+ */
+typedef struct {
+  pthread_mutex_t mtx; ///< Mutex per l'accesso a \ref list
+  free_list_t list; ///< Oggetti liberi
+} depot_t;
+
+/// Depositi globali, uno per classe
+static depot_t depots[NUM_CLASSES];
+
+/// Liste del thread corrente
+static __thread thread_cache_t *self = NULL;
+
+/// Chiave usata per svuotare le liste alla terminazione del thread
+static pthread_key_t cache_key;
+
+/// Inizializzazione di \ref cache_key e dei depositi
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Dimensione degli oggetti di una classe
+ */
+static size_t class_size(size_t cls) {
+  if(cls == 0) return (size_t)1 << MIN_SHIFT;
+  if(cls % 2 == 1) return (size_t)3 << (MIN_SHIFT - 1 + (cls - 1) / 2);
+  return (size_t)1 << (MIN_SHIFT + cls / 2);
+}
+
+/**
+ * \brief Classe più piccola che contiene oggetti di \p size byte
+ */
+static size_t class_of(size_t size) {
+  if(size <= ((size_t)1 << MIN_SHIFT)) return 0;
+  if(size > CSLAB_MAX_SIZE) return LARGE_CLASS;
+
+  /* 2^shift < size <= 2^(shift + 1) */
+  size_t shift = 63 - __builtin_clzll((unsigned long long)(size - 1));
+  size_t cls = (shift - MIN_SHIFT) * 2;
+  return size <= ((size_t)3 << (shift - 1)) ? cls + 1 : cls + 2;
+}
+
+/**
+ * \brief Numero massimo di oggetti di una classe nella lista di un thread
+ */
+static size_t cache_limit(size_t cls) {
+  size_t limit = CACHE_BYTES / class_size(cls);
+  if(limit < MIN_CACHED) return MIN_CACHED;
+  if(limit > MAX_CACHED) return MAX_CACHED;
+  return limit;
+}
+
+/**
+ * \brief Sposta fino a \p n oggetti di una classe dalla lista \p from al
+ *        deposito, restituendo a free quelli che non vi trovano posto
+ */
+static void give_back(size_t cls, free_list_t *from, size_t n) {
+  depot_t *d = &(depots[cls]);
+  size_t limit = cache_limit(cls) * DEPOT_FACTOR;
+
+  pthread_mutex_lock(&(d->mtx));
+  while(n > 0 && from->head != NULL && d->list.n < limit) {
+    free_obj_t *o = from->head;
+    from->head = o->next;
+    from->n--;
+    o->next = d->list.head;
+    d->list.head = o;
+    d->list.n++;
+    n--;
+  }
+  pthread_mutex_unlock(&(d->mtx));
+
+  while(n > 0 && from->head != NULL) {
+    free_obj_t *o = from->head;
+    from->head = o->next;
+    from->n--;
+    free(o);
+    n--;
+  }
+}
+
+/**
+ * \brief Sposta nel deposito tutte le liste di un thread che termina
+ */
+static void release_cache(void *ptr) {
+  thread_cache_t *cache = (thread_cache_t*)ptr;
+  for(size_t c = 0; c < NUM_CLASSES; c++) {
+    give_back(c, &(cache->lists[c]), cache->lists[c].n);
+  }
+  free(cache);
+  self = NULL;
+}
+
+static void init(void) {
+  for(size_t c = 0; c < NUM_CLASSES; c++) {
+    if(pthread_mutex_init(&(depots[c].mtx), NULL) != 0) abort();
+  }
+  if(pthread_key_create(&cache_key, release_cache) != 0) abort();
+}
+
+/**
+ * \brief Restituisce le liste del thread corrente, creandole se necessario
+ *
+ * \return thread_cache_t* Le liste, NULL se non è stato possibile crearle
+ */
+static thread_cache_t *get_cache(void) {
+  if(self != NULL) return self;
+
+  pthread_once(&init_once, init);
+  thread_cache_t *cache = calloc(1, sizeof(thread_cache_t));
+  if(cache == NULL) return NULL;
+  if(pthread_setspecific(cache_key, cache) != 0) {
+    free(cache);
+    return NULL;
+  }
+  self = cache;
+  return cache;
+}
+
+void *cslab_alloc(size_t size) {
+  size_t cls = class_of(size);
+  header_t *h = NULL;
+
+  if(cls == LARGE_CLASS) {
+    if(size > SIZE_MAX - sizeof(header_t)) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    h = malloc(sizeof(header_t) + size);
+  } else {
+    thread_cache_t *cache = get_cache();
+    free_list_t *list = cache != NULL ? &(cache->lists[cls]) : NULL;
+
+    if(list != NULL && list->head == NULL) {
+      /* La lista è vuota: si prende metà del suo limite dal deposito */
+      depot_t *d = &(depots[cls]);
+      size_t n = cache_limit(cls) / 2;
+      pthread_mutex_lock(&(d->mtx));
+      while(n > 0 && d->list.head != NULL) {
+        free_obj_t *o = d->list.head;
+        d->list.head = o->next;
+        d->list.n--;
+        o->next = list->head;
+        list->head = o;
+        list->n++;
+        n--;
+      }
+      pthread_mutex_unlock(&(d->mtx));
+    }
+
+    if(list != NULL && list->head != NULL) {
+      free_obj_t *o = list->head;
+      list->head = o->next;
+      list->n--;
+      h = (header_t*)o;
+    } else {
+      h = malloc(sizeof(header_t) + class_size(cls));
+    }
+  }
+
+  if(h == NULL) return NULL;
+  h->cls = cls;
+  return h + 1;
+}
+
+void *cslab_calloc(size_t nmemb, size_t size) {
+  if(size != 0 && nmemb > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  void *ptr = cslab_alloc(nmemb * size);
+  if(ptr != NULL) memset(ptr, 0, nmemb * size);
+  return ptr;
+}
+
+void cslab_free(void *ptr) {
+  if(ptr == NULL) return;
+
+  header_t *h = (header_t*)ptr - 1;
+  size_t cls = h->cls;
+  thread_cache_t *cache;
+
+  if(cls == LARGE_CLASS || (cache = get_cache()) == NULL) {
+    free(h);
+    return;
+  }
+
+  free_list_t *list = &(cache->lists[cls]);
+  free_obj_t *o = (free_obj_t*)h;
+  o->next = list->head;
+  list->head = o;
+  list->n++;
+
+  if(list->n > cache_limit(cls)) {
+    /* Metà della lista passa al deposito, in modo che il thread possa
+       continuare ad allocare e deallocare senza tornarci subito */
+    give_back(cls, list, list->n / 2);
+  }
+}
+
+void cslab_release(void) {
+  pthread_once(&init_once, init);
+
+  if(self != NULL) {
+    thread_cache_t *cache = self;
+    for(size_t c = 0; c < NUM_CLASSES; c++) {
+      while(cache->lists[c].head != NULL) {
+        free_obj_t *o = cache->lists[c].head;
+        cache->lists[c].head = o->next;
+        free(o);
+      }
+    }
+    pthread_setspecific(cache_key, NULL);
+    free(cache);
+    self = NULL;
+  }
+
+  for(size_t c = 0; c < NUM_CLASSES; c++) {
+    depot_t *d = &(depots[c]);
+    pthread_mutex_lock(&(d->mtx));
+    while(d->list.head != NULL) {
+      free_obj_t *o = d->list.head;
+      d->list.head = o->next;
+      free(o);
+    }
+    d->list.n = 0;
+    pthread_mutex_unlock(&(d->mtx));
+  }
+}
@@ -0,0 +1,73 @@
+/**
+ *  \file cslab.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Allocatore per classi di dimensione con cache per thread
+ * Consente di allocare e deallocare ripetutamente oggetti di piccole e medie
+ * dimensioni senza passare ogni volta per malloc e free.
+ *
+ * Le richieste vengono arrotondate ad una classe di dimensione (potenze di 2
+ * e loro multipli per 1.5, fino a \ref CSLAB_MAX_SIZE). Gli oggetti
+ * deallocati non vengono restituiti a free, ma conservati in una lista per
+ * classe privata del thread che li dealloca, da cui vengono prese le
+ * allocazioni successive della stessa classe senza alcuna sincronizzazione.
+ * Quando la lista di un thread supera il suo limite, metà degli oggetti
+ * viene spostata in un deposito globale per classe, protetto da un mutex, da
+ * cui attingono i thread che esauriscono la propria lista: in questo modo
+ * gli oggetti allocati da un thread e deallocati da un altro, come i messaggi
+ * letti da un client e scritti ad un altro, tornano in circolo. Anche il
+ * deposito è limitato, e gli oggetti in eccesso vengono restituiti a free.
+ *
+ * Le richieste più grandi di \ref CSLAB_MAX_SIZE vengono servite
+ * direttamente da malloc, ma vanno comunque deallocate con \ref cslab_free.
+ */
+
+#ifndef CSLAB_H
+#define CSLAB_H
+
+#include <stddef.h>
+
+/// Dimensione massima delle richieste servite dalle classi
+#define CSLAB_MAX_SIZE (64 * 1024)
+
+/**
+ * \brief Alloca un oggetto
+ *
+ * \param size La dimensione dell'oggetto
+ * \return void* L'oggetto, non inizializzato. NULL e errno impostato in caso di errore
+ */
+void *cslab_alloc(size_t size);
+
+/**
+ * \brief Alloca un vettore di oggetti inizializzato a zero
+ *
+ * \param nmemb Il numero di elementi
+ * \param size La dimensione di ogni elemento
+ * \return void* Il vettore, NULL e errno impostato in caso di errore
+ */
+void *cslab_calloc(size_t nmemb, size_t size);
+
+/**
+ * \brief Dealloca un oggetto ottenuto da \ref cslab_alloc o \ref cslab_calloc
+ *
+ * Può essere chiamata da un thread diverso da quello che ha allocato
+ * l'oggetto.
+ *
+ * \param ptr L'oggetto da deallocare, può essere NULL
+ */
+void cslab_free(void *ptr);
+
+/**
+ * \brief Restituisce a free gli oggetti conservati dal thread chiamante e dal
+ *        deposito globale
+ *
+ * Le liste dei thread terminati vengono spostate automaticamente nel
+ * deposito. Va chiamata alla terminazione del programma, dopo che gli altri
+ * thread sono terminati.
+ */
+void cslab_release(void);
+
+#endif /* CSLAB_H */
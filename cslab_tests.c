@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "cslab.h"
+
+#define PRODUCERS 3
+#define OBJECTS 100000
+#define SLOTS 1024
+
+/* Gli oggetti passano dai produttori al consumatore attraverso un vettore
+   circolare protetto da un mutex, in modo da essere deallocati da un thread
+   diverso da quello che li ha allocati */
+void *slots[SLOTS];
+int head = 0, tail = 0, count = 0;
+pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+
+void fill(unsigned char *p, size_t size, unsigned char v) {
+  for(size_t i = 0; i < size; i++) p[i] = v;
+}
+
+void check(const unsigned char *p, size_t size, unsigned char v) {
+  for(size_t i = 0; i < size; i++) assert(p[i] == v);
+}
+
+void *producer(void *ud) {
+  unsigned int r = *(int*)ud + 1;
+
+  for(int i = 0; i < OBJECTS; i++) {
+    r = r * 1103515245 + 12345;
+    size_t size = sizeof(size_t) + 1 + (r >> 8) % 2048;
+    size_t *obj = cslab_alloc(size);
+    assert(obj != NULL);
+    obj[0] = size;
+    fill((unsigned char*)(obj + 1), size - sizeof(size_t), (unsigned char)size);
+
+    pthread_mutex_lock(&mtx);
+    while(count == SLOTS) pthread_cond_wait(&not_full, &mtx);
+    slots[tail] = obj;
+    tail = (tail + 1) % SLOTS;
+    count++;
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&mtx);
+  }
+  return NULL;
+}
+
+void *consumer(void *ud) {
+  for(int i = 0; i < PRODUCERS * OBJECTS; i++) {
+    pthread_mutex_lock(&mtx);
+    while(count == 0) pthread_cond_wait(&not_empty, &mtx);
+    size_t *obj = slots[head];
+    head = (head + 1) % SLOTS;
+    count--;
+    pthread_cond_signal(&not_full);
+    pthread_mutex_unlock(&mtx);
+
+    size_t size = obj[0];
+    check((unsigned char*)(obj + 1), size - sizeof(size_t), (unsigned char)size);
+    cslab_free(obj);
+  }
+  return NULL;
+}
+
+int main(void) {
+  /* Tutte le dimensioni, comprese quelle servite direttamente da malloc */
+  for(size_t size = 0; size <= CSLAB_MAX_SIZE + 4096; size += (size < 1024 ? 1 : 509)) {
+    unsigned char *p = cslab_alloc(size);
+    assert(p != NULL);
+    assert((uintptr_t)p % sizeof(void*) == 0);
+    fill(p, size, 0xAB);
+    cslab_free(p);
+  }
+  cslab_free(NULL);
+
+  /* Un oggetto deallocato viene riutilizzato dalla successiva allocazione
+     della stessa classe, e cslab_calloc lo azzera */
+  unsigned char *a = cslab_alloc(100);
+  fill(a, 100, 0xFF);
+  cslab_free(a);
+  unsigned char *b = cslab_alloc(97);
+  assert(a == b);
+  cslab_free(b);
+  b = cslab_calloc(25, 4);
+  assert(a == b);
+  check(b, 100, 0);
+  cslab_free(b);
+  assert(cslab_calloc(SIZE_MAX / 2, 4) == NULL);
+
+  /* Oggetti di classi diverse restano distinti */
+  void *objs[1000];
+  for(int i = 0; i < 1000; i++) {
+    size_t size = 1 + i * 7;
+    objs[i] = cslab_alloc(size);
+    fill(objs[i], size, (unsigned char)i);
+  }
+  for(int i = 0; i < 1000; i++) {
+    check(objs[i], 1 + i * 7, (unsigned char)i);
+    cslab_free(objs[i]);
+  }
+
+  /* Allocazioni e deallocazioni da thread diversi */
+  pthread_t producers[PRODUCERS], cons;
+  int ids[PRODUCERS];
+  pthread_create(&cons, NULL, consumer, NULL);
+  for(int i = 0; i < PRODUCERS; i++) {
+    ids[i] = i;
+    pthread_create(producers + i, NULL, producer, ids + i);
+  }
+  for(int i = 0; i < PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  pthread_join(cons, NULL);
+
+  cslab_release();
+  return 0;
+}
@@ -0,0 +1,196 @@
+/**
+ *  \file msgbuf.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "msgbuf.h"
+#include "cslab.h"
+
+/// Lunghezza degli header di un messaggio
+#define HEADERS_LEN (sizeof(message_hdr_t) + sizeof(message_data_hdr_t))
+
+int msgbuf_init(msgbuf_t *buf, size_t cap) {
+  if(buf == NULL || cap < HEADERS_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  buf->data = malloc(cap);
+  if(buf->data == NULL) {
+    return -1;
+  }
+  buf->cap = cap;
+  buf->min_cap = cap;
+  buf->start = 0;
+  buf->end = 0;
+  return 0;
+}
+
+void msgbuf_free(msgbuf_t *buf) {
+  if(buf == NULL) return;
+
+  free(buf->data);
+  buf->data = NULL;
+  buf->cap = 0;
+  buf->min_cap = 0;
+  buf->start = 0;
+  buf->end = 0;
+}
+
+/**
+ * \brief Calcola quanti byte, a partire da \ref msgbuf_t.start, occupa la
+ *        prossima richiesta
+ *
+ * Finchè gli header non sono stati ricevuti la lunghezza non è nota: in
+ * quel caso viene restituito il numero di byte necessari per conoscerla.
+ *
+ * \param buf Il buffer della connessione
+ * \return size_t La lunghezza della richiesta, o un suo limite inferiore
+ */
+static size_t request_len(msgbuf_t *buf) {
+  size_t avail = buf->end - buf->start;
+  const char *p = buf->data + buf->start;
+  if(avail < HEADERS_LEN) return HEADERS_LEN;
+
+  message_hdr_t hdr;
+  message_data_hdr_t dhdr;
+  memcpy(&hdr, p, sizeof(hdr));
+  memcpy(&dhdr, p + sizeof(message_hdr_t), sizeof(dhdr));
+  size_t len = HEADERS_LEN + dhdr.len;
+  if(hdr.op != POSTFILE_OP) return len;
+
+  /* Una richiesta di invio file è seguita dal file */
+  if(avail < len + sizeof(message_data_hdr_t)) return len + sizeof(message_data_hdr_t);
+  memcpy(&dhdr, p + len, sizeof(dhdr));
+  return len + sizeof(message_data_hdr_t) + dhdr.len;
+}
+
+/**
+ * \brief Riceve da \p fd i dati disponibili, finchè il buffer non contiene
+ *        una richiesta completa
+ *
+ * \param fd Il descrittore da cui leggere
+ * \param buf Il buffer della connessione
+ * \return int 1 se il buffer contiene una richiesta completa, 0 se il socket
+ *             si è chiuso, -1 ed errno impostato in caso di errore (EAGAIN
+ *             se la richiesta è incompleta)
+ */
+static int fill(long fd, msgbuf_t *buf) {
+  for(;;) {
+    size_t need = request_len(buf);
+    size_t avail = buf->end - buf->start;
+    if(avail >= need) return 1;
+
+    if(buf->start + need > buf->cap) {
+      /* La richiesta non entra nello spazio rimasto: i dati vengono
+         spostati all'inizio e, se necessario, il buffer viene ingrandito */
+      memmove(buf->data, buf->data + buf->start, avail);
+      buf->start = 0;
+      buf->end = avail;
+      if(need > buf->cap) {
+        char *data = realloc(buf->data, need);
+        if(data == NULL) return -1;
+        buf->data = data;
+        buf->cap = need;
+      }
+    }
+
+    ssize_t r = recv(fd, buf->data + buf->end, buf->cap - buf->end, 0);
+    if(r == 0) return 0;
+    if(r < 0) {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    buf->end += r;
+  }
+}
+
+/**
+ * \brief Estrae \p len byte dal buffer
+ *
+ * Quando il buffer si svuota torna alla sua capienza iniziale.
+ *
+ * \param buf Il buffer della connessione
+ * \param dst Dove porre i dati estratti
+ * \param len Numero di byte da estrarre
+ * \return int 1 in caso di successo, -1 con errno impostato a EAGAIN se il
+ *             buffer non contiene abbastanza dati
+ */
+static int take(msgbuf_t *buf, void *dst, size_t len) {
+  if(buf->end - buf->start < len) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  memcpy(dst, buf->data + buf->start, len);
+  buf->start += len;
+
+  if(buf->start == buf->end) {
+    buf->start = 0;
+    buf->end = 0;
+    if(buf->cap > buf->min_cap) {
+      char *data = realloc(buf->data, buf->min_cap);
+      if(data != NULL) {
+        buf->data = data;
+        buf->cap = buf->min_cap;
+      }
+    }
+  }
+  return 1;
+}
+
+int msgbuf_has_msg(msgbuf_t *buf) {
+  return buf->end - buf->start >= request_len(buf);
+}
+
+/**
+ * \brief Estrae la parte dati di un messaggio
+ *
+ * \param buf Il buffer della connessione
+ * \param data Dove porre la parte dati
+ * \return int Vedi take
+ */
+static int take_data(msgbuf_t *buf, message_data_t *data) {
+  message_data_hdr_t hdr;
+  if(buf->end - buf->start < sizeof(hdr)) {
+    errno = EAGAIN;
+    return -1;
+  }
+  memcpy(&hdr, buf->data + buf->start, sizeof(hdr));
+  if(buf->end - buf->start - sizeof(hdr) < hdr.len) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  char *body = cslab_alloc(hdr.len);
+  if(body == NULL) {
+    return -1;
+  }
+
+  take(buf, &(data->hdr), sizeof(hdr));
+  take(buf, body, hdr.len);
+  data->buf = body;
+  return 1;
+}
+
+int msgbuf_read_data(long fd, msgbuf_t *buf, message_data_t *data) {
+  return take_data(buf, data);
+}
+
+int msgbuf_read_msg(long fd, msgbuf_t *buf, message_t *msg) {
+  int res = fill(fd, buf);
+  if(res <= 0) return res;
+
+  take(buf, &(msg->hdr), sizeof(message_hdr_t));
+  return take_data(buf, &(msg->data));
+}
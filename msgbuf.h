@@ -0,0 +1,103 @@
+/**
+ *  \file msgbuf.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Lettura bufferizzata dei messaggi
+ * Ogni connessione ha un buffer di ingresso, riempito con una sola recv di
+ * tutti i dati disponibili. I messaggi vengono poi estratti dal buffer, per
+ * cui più richieste inviate di seguito dallo stesso client possono essere
+ * lette con una sola chiamata di sistema. Il formato dei messaggi è lo stesso
+ * di \ref readMsg.
+ *
+ * La lettura non attende mai: una richiesta viene estratta solo quando è
+ * stata ricevuta per intero, compreso il file che segue una richiesta
+ * \ref POSTFILE_OP. Finchè è incompleta, la parte ricevuta resta nel buffer,
+ * che cresce se necessario per contenerla, e la lettura riprende alla
+ * successiva notifica del descrittore.
+ *
+ * Un buffer non è thread-safe: deve essere usato da un solo thread alla volta.
+ */
+
+#ifndef MSGBUF_H
+#define MSGBUF_H
+
+#include <sys/types.h>
+
+#include "message.h"
+
+/**
+ * \brief Buffer di ingresso di una connessione
+ */
+typedef struct {
+  char *data; ///< Dati ricevuti, NULL se il buffer non è inizializzato
+  size_t cap; ///< Capienza di \ref data
+  size_t min_cap; ///< Capienza a cui il buffer torna quando viene svuotato
+  size_t start; ///< Inizio dei dati non ancora letti
+  size_t end; ///< Fine dei dati non ancora letti
+} msgbuf_t;
+
+/**
+ * \brief Inizializza un buffer
+ *
+ * \param buf Il buffer da inizializzare
+ * \param cap La capienza del buffer. Deve poter contenere almeno gli header
+ *            di un messaggio
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int msgbuf_init(msgbuf_t *buf, size_t cap);
+
+/**
+ * \brief Dealloca il contenuto di un buffer, scartando i dati non letti
+ *
+ * \param buf Il buffer da deallocare
+ */
+void msgbuf_free(msgbuf_t *buf);
+
+/**
+ * \brief Indica se il buffer contiene una richiesta completa, che può quindi
+ *        essere letta senza chiamate di sistema
+ *
+ * \param buf Il buffer da controllare
+ * \return int 1 se è presente una richiesta completa, 0 altrimenti
+ */
+int msgbuf_has_msg(msgbuf_t *buf);
+
+/**
+ * \brief Legge una richiesta, ricevendo da \p fd (non bloccante) i dati
+ *        non ancora presenti nel buffer
+ *
+ * Se la richiesta non è ancora stata ricevuta per intero la chiamata
+ * fallisce con errno impostato a EAGAIN, e la parte ricevuta viene
+ * conservata nel buffer.
+ *
+ * \param fd Il descrittore da cui leggere
+ * \param buf Il buffer della connessione
+ * \param msg Il messaggio letto. Il buffer dei dati va deallocato dal
+ *            chiamante con \ref cslab_free
+ * \return int <0 se si è verificato un errore o la richiesta è incompleta,
+ *             =0 se il socket si è chiuso,
+ *             >0 se l'operazione ha avuto successo
+ */
+int msgbuf_read_msg(long fd, msgbuf_t *buf, message_t *msg);
+
+/**
+ * \brief Legge la parte dati che segue un messaggio, come il file di una
+ *        richiesta \ref POSTFILE_OP
+ *
+ * I dati vengono ricevuti insieme alla richiesta da \ref msgbuf_read_msg, per
+ * cui vengono estratti dal buffer senza chiamate di sistema. Se non sono
+ * presenti la chiamata fallisce con errno impostato a EAGAIN.
+ *
+ * \param fd Il descrittore da cui leggere
+ * \param buf Il buffer della connessione
+ * \param data I dati letti. Il buffer va deallocato dal chiamante con
+ *             \ref cslab_free
+ * \return int <0 se si è verificato un errore,
+ *             >0 se l'operazione ha avuto successo
+ */
+int msgbuf_read_data(long fd, msgbuf_t *buf, message_data_t *data);
+
+#endif /* MSGBUF_H */
@@ -0,0 +1,375 @@
+/**
+ *  \file outqueue.c
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "outqueue.h"
+#include "cslab.h"
+
+/// Numero massimo di messaggi scritti con una sola writev
+#define MAX_FLUSH_MSGS 64
+
+/// Stati di una coda
+enum { STATE_CLOSED = 0, STATE_OPEN, STATE_BROKEN };
+
+/**
+ * \brief Messaggio in attesa di essere inviato
+ */
+typedef struct out_msg {
+  message_hdr_t hdr; ///< Header del messaggio
+  message_data_hdr_t dhdr; ///< Header dei dati
+  char *body; ///< Corpo del messaggio, di proprietà della coda se \ref shared è NULL
+  cmessage_t *shared; ///< Messaggio condiviso che contiene il corpo, o NULL
+  int header_only; ///< 1 se va inviato solamente l'header
+  size_t off; ///< Byte del messaggio già inviati
+  struct out_msg *next; ///< Messaggio successivo
+} out_msg_t;
+
+/**
+ * \brief Calcola la lunghezza totale di un messaggio sul socket
+ */
+static size_t msg_len(out_msg_t *m) {
+  size_t len = sizeof(message_hdr_t);
+  if(!m->header_only) {
+    len += sizeof(message_data_hdr_t);
+    if(m->body != NULL) len += m->dhdr.len;
+  }
+  return len;
+}
+
+/**
+ * \brief Aggiunge ad \p iov le parti di \p m non ancora inviate
+ *
+ * \return int Il numero di elementi di \p iov usati (al più 3)
+ */
+static int msg_iov(out_msg_t *m, struct iovec *iov) {
+  struct iovec parts[3] = {
+    { &(m->hdr), sizeof(message_hdr_t) },
+    { &(m->dhdr), sizeof(message_data_hdr_t) },
+    { m->body, m->body != NULL ? m->dhdr.len : 0 }
+  };
+  int nparts = m->header_only ? 1 : 3;
+
+  size_t skip = m->off;
+  int n = 0;
+  for(int i = 0; i < nparts; i++) {
+    if(skip >= parts[i].iov_len) {
+      skip -= parts[i].iov_len;
+      continue;
+    }
+    iov[n].iov_base = (char*)parts[i].iov_base + skip;
+    iov[n].iov_len = parts[i].iov_len - skip;
+    skip = 0;
+    n++;
+  }
+  return n;
+}
+
+static void msg_free(out_msg_t *m) {
+  if(m->shared != NULL) {
+    cmessage_unref(m->shared);
+  } else {
+    cslab_free(m->body);
+  }
+  cslab_free(m);
+}
+
+/**
+ * \brief Scarta tutti i messaggi in coda. Va chiamata con il mutex acquisito
+ */
+static void discard(outqueue_t *q) {
+  out_msg_t *m = q->head;
+  while(m != NULL) {
+    out_msg_t *next = m->next;
+    msg_free(m);
+    m = next;
+  }
+  q->head = q->tail = NULL;
+  q->len = 0;
+}
+
+/**
+ * \brief Interrompe la connessione: i messaggi vengono scartati e il socket
+ *        viene chiuso in entrambe le direzioni, per cui chi lo legge riceverà
+ *        una fine del file. Va chiamata con il mutex acquisito
+ */
+static void break_conn(outqueue_t *q, long fd) {
+  discard(q);
+  q->state = STATE_BROKEN;
+  shutdown(fd, SHUT_RDWR);
+}
+
+/**
+ * \brief Riattiva il descrittore su \p epfd, per essere notificati quando
+ *        il socket torna scrivibile
+ */
+static int arm(long fd, int epfd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLOUT | EPOLLONESHOT;
+  ev.data.fd = fd;
+  return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/**
+ * \brief Scrive quanto possibile dei messaggi in coda. Va chiamata con il
+ *        mutex acquisito
+ *
+ * \return int 1 se la coda è stata svuotata, 0 se il socket non accetta
+ *             altri dati, -1 ed errno impostato in caso di errore
+ */
+static int drain(outqueue_t *q, long fd) {
+  struct iovec iov[MAX_FLUSH_MSGS * 3];
+
+  while(q->head != NULL) {
+    int niov = 0, nmsgs = 0;
+    for(out_msg_t *m = q->head; m != NULL && nmsgs < MAX_FLUSH_MSGS; m = m->next) {
+      niov += msg_iov(m, iov + niov);
+      nmsgs++;
+    }
+
+    ssize_t w = writev(fd, iov, niov);
+    if(w < 0) {
+      if(errno == EINTR) continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      return -1;
+    }
+
+    size_t left = w;
+    while(left > 0) {
+      out_msg_t *m = q->head;
+      size_t rem = msg_len(m) - m->off;
+      if(left < rem) {
+        m->off += left;
+        break;
+      }
+      left -= rem;
+      q->head = m->next;
+      q->len--;
+      msg_free(m);
+    }
+    if(q->head == NULL) q->tail = NULL;
+  }
+
+  return 1;
+}
+
+/**
+ * \brief Accoda una copia di \p msg, di cui sono già stati inviati \p off byte.
+ *        Se \p shared non è NULL, i dati non vengono copiati ma condivisi
+ */
+static int enqueue(outqueue_t *q, message_t *msg, cmessage_t *shared, int header_only, size_t off) {
+  out_msg_t *m = cslab_alloc(sizeof(out_msg_t));
+  if(m == NULL) return -1;
+
+  m->hdr = msg->hdr;
+  m->dhdr = msg->data.hdr;
+  m->header_only = header_only;
+  m->off = off;
+  m->next = NULL;
+  m->body = NULL;
+  m->shared = NULL;
+  if(!header_only && shared != NULL) {
+    m->body = msg->data.buf;
+    m->shared = cmessage_ref(shared);
+  } else if(!header_only && msg->data.buf != NULL && msg->data.hdr.len > 0) {
+    m->body = cslab_alloc(msg->data.hdr.len);
+    if(m->body == NULL) {
+      cslab_free(m);
+      return -1;
+    }
+    memcpy(m->body, msg->data.buf, msg->data.hdr.len);
+  }
+
+  if(q->tail == NULL) {
+    q->head = m;
+  } else {
+    q->tail->next = m;
+  }
+  q->tail = m;
+  q->len++;
+  return 0;
+}
+
+int outqueue_init(outqueue_t *q) {
+  if(q == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int err = pthread_mutex_init(&(q->mtx), NULL);
+  if(err) {
+    errno = err;
+    return -1;
+  }
+  q->head = q->tail = NULL;
+  q->len = 0;
+  q->state = STATE_CLOSED;
+  q->gen = 0;
+  return 0;
+}
+
+void outqueue_destroy(outqueue_t *q) {
+  if(q == NULL) return;
+
+  discard(q);
+  pthread_mutex_destroy(&(q->mtx));
+}
+
+int outqueue_open(outqueue_t *q, long fd, int epfd) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLONESHOT;
+  ev.data.fd = fd;
+
+  pthread_mutex_lock(&(q->mtx));
+  int res = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+  if(res == 0) {
+    q->state = STATE_OPEN;
+    q->gen = (q->gen + 1) & OUTQUEUE_MAX_GEN;
+  }
+  pthread_mutex_unlock(&(q->mtx));
+  return res;
+}
+
+void outqueue_close(outqueue_t *q, long fd, int epfd) {
+  pthread_mutex_lock(&(q->mtx));
+  discard(q);
+  if(q->state != STATE_CLOSED) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  }
+  q->state = STATE_CLOSED;
+  /* Chi ha conservato la generazione precedente non può più usare il
+     descrittore, anche se viene riassegnato */
+  q->gen = (q->gen + 1) & OUTQUEUE_MAX_GEN;
+  pthread_mutex_unlock(&(q->mtx));
+}
+
+unsigned int outqueue_generation(outqueue_t *q) {
+  pthread_mutex_lock(&(q->mtx));
+  unsigned int gen = q->gen;
+  pthread_mutex_unlock(&(q->mtx));
+  return gen;
+}
+
+int outqueue_send(outqueue_t *q, long fd, unsigned int gen, int epfd, size_t max, outqueue_policy_t policy,
+                  message_t **msgs, cmessage_t **shared, int n, int header_only) {
+  if(q == NULL || msgs == NULL || n < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&(q->mtx));
+  if(q->state != STATE_OPEN || (gen != OUTQUEUE_ANY_GEN && gen != q->gen)) {
+    /* La connessione a cui erano destinati i messaggi è stata chiusa */
+    pthread_mutex_unlock(&(q->mtx));
+    return 0;
+  }
+
+  if(max > 0 && q->len > 0 && q->len + n > max) {
+    if(policy == OUTQUEUE_DROP) {
+      pthread_mutex_unlock(&(q->mtx));
+      errno = ENOBUFS;
+      return -1;
+    }
+    break_conn(q, fd);
+    pthread_mutex_unlock(&(q->mtx));
+    return 0;
+  }
+
+  int was_empty = q->head == NULL;
+  size_t sent = 0;
+
+  if(was_empty) {
+    /* Nessun messaggio precedente in attesa: si prova a scrivere subito,
+       senza copiare i messaggi */
+    out_msg_t *tmp = cslab_calloc(n > MAX_FLUSH_MSGS ? MAX_FLUSH_MSGS : n, sizeof(out_msg_t));
+    struct iovec iov[MAX_FLUSH_MSGS * 3];
+    int niov = 0;
+    if(tmp == NULL && n > 0) {
+      pthread_mutex_unlock(&(q->mtx));
+      return -1;
+    }
+    for(int i = 0; i < n && i < MAX_FLUSH_MSGS; i++) {
+      tmp[i].hdr = msgs[i]->hdr;
+      tmp[i].dhdr = msgs[i]->data.hdr;
+      tmp[i].body = msgs[i]->data.buf;
+      tmp[i].header_only = header_only;
+      niov += msg_iov(tmp + i, iov + niov);
+    }
+
+    ssize_t w;
+    do {
+      w = writev(fd, iov, niov);
+    } while(w < 0 && errno == EINTR);
+    cslab_free(tmp);
+
+    if(w < 0) {
+      if(errno != EAGAIN && errno != EWOULDBLOCK) {
+        break_conn(q, fd);
+        pthread_mutex_unlock(&(q->mtx));
+        return 0;
+      }
+      w = 0;
+    }
+    sent = w;
+  }
+
+  /* Si accoda quanto non è stato scritto */
+  for(int i = 0; i < n; i++) {
+    out_msg_t view;
+    view.dhdr = msgs[i]->data.hdr;
+    view.body = msgs[i]->data.buf;
+    view.header_only = header_only;
+    size_t len = msg_len(&view);
+
+    if(sent >= len) {
+      sent -= len;
+      continue;
+    }
+    if(enqueue(q, msgs[i], shared != NULL ? shared[i] : NULL, header_only, sent) != 0) {
+      /* Il messaggio è stato scritto solo in parte: il flusso non può più
+         essere ripreso */
+      int err = errno;
+      if(sent > 0) break_conn(q, fd);
+      pthread_mutex_unlock(&(q->mtx));
+      errno = err;
+      return sent > 0 ? 0 : -1;
+    }
+    sent = 0;
+  }
+
+  if(was_empty && q->head != NULL && arm(fd, epfd) != 0) {
+    int err = errno;
+    pthread_mutex_unlock(&(q->mtx));
+    errno = err;
+    return -1;
+  }
+
+  pthread_mutex_unlock(&(q->mtx));
+  return 1;
+}
+
+void outqueue_flush(outqueue_t *q, long fd, int epfd) {
+  pthread_mutex_lock(&(q->mtx));
+  if(q->state == STATE_OPEN && q->head != NULL) {
+    int res = drain(q, fd);
+    if(res < 0) {
+      break_conn(q, fd);
+    } else if(res == 0 && arm(fd, epfd) != 0) {
+      break_conn(q, fd);
+    }
+  }
+  pthread_mutex_unlock(&(q->mtx));
+}
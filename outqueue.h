@@ -0,0 +1,153 @@
+/**
+ *  \file outqueue.h
+ *  \author Francesco Bertolaccini 543981
+ *
+ *   Si dichiara che il contenuto di questo file e' in ogni sua parte opera
+ *     originale dell'autore
+ *
+ * \brief Code di uscita delle connessioni
+ * I messaggi diretti ad un client vengono scritti immediatamente sul socket
+ * (non bloccante) se possibile. La parte che non può essere scritta viene
+ * accodata, e il descrittore viene registrato in scrittura su un'istanza
+ * epoll: quando il socket torna scrivibile, la coda viene svuotata da
+ * \ref outqueue_flush. In questo modo l'invio di un messaggio non si blocca
+ * mai su un client lento.
+ *
+ * La coda è limitata: quando è piena, i nuovi messaggi vengono scartati
+ * oppure il client viene disconnesso, a seconda della politica scelta.
+ *
+ * La coda non chiude mai il descrittore: in caso di errori o di
+ * disconnessione forzata effettua una shutdown del socket, in modo che il
+ * thread che lo legge si accorga della disconnessione.
+ *
+ * Poichè i numeri dei descrittori vengono riutilizzati, ogni coda ha una
+ * generazione che cambia ad ogni apertura e chiusura: chi conserva un
+ * descrittore oltre la richiesta in corso ne conserva anche la generazione,
+ * e la passa a \ref outqueue_send in modo che i messaggi non vengano
+ * inviati ad una nuova connessione con lo stesso descrittore.
+ */
+
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "message.h"
+#include "cmessage.h"
+
+/**
+ * \brief Comportamento di una coda piena
+ */
+typedef enum {
+  OUTQUEUE_DISCONNECT = 0, ///< Il client viene disconnesso
+  OUTQUEUE_DROP ///< Il nuovo messaggio viene scartato
+} outqueue_policy_t;
+
+/// Generazione da passare a \ref outqueue_send per non verificarla
+#define OUTQUEUE_ANY_GEN ((unsigned int)-1)
+
+/// Valore massimo della generazione di una coda
+#define OUTQUEUE_MAX_GEN 0x7FFFFFFFU
+
+struct out_msg;
+
+/**
+ * \brief Coda di uscita di una connessione
+ */
+typedef struct {
+  pthread_mutex_t mtx; ///< Mutex d'accesso alla coda
+  struct out_msg *head; ///< Primo messaggio da inviare
+  struct out_msg *tail; ///< Ultimo messaggio da inviare
+  size_t len; ///< Numero di messaggi in coda
+  int state; ///< Stato della connessione
+  unsigned int gen; ///< Generazione, cambia ad ogni apertura e chiusura
+} outqueue_t;
+
+/**
+ * \brief Inizializza una coda, inizialmente chiusa
+ *
+ * \param q La coda da inizializzare
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int outqueue_init(outqueue_t *q);
+
+/**
+ * \brief Dealloca una coda, scartando i messaggi non inviati
+ *
+ * \param q La coda da deallocare
+ */
+void outqueue_destroy(outqueue_t *q);
+
+/**
+ * \brief Apre la coda per una nuova connessione e registra il descrittore
+ *        (disattivato) su \p epfd
+ *
+ * \param q La coda da aprire
+ * \param fd Il descrittore della connessione
+ * \param epfd L'istanza epoll usata per attendere che il socket sia scrivibile
+ * \return int 0 in caso di successo, -1 ed errno impostato altrimenti
+ */
+int outqueue_open(outqueue_t *q, long fd, int epfd);
+
+/**
+ * \brief Chiude la coda, scartando i messaggi non inviati, e rimuove il
+ *        descrittore da \p epfd. Va chiamata prima di chiudere \p fd
+ *
+ * \param q La coda da chiudere
+ * \param fd Il descrittore della connessione
+ * \param epfd L'istanza epoll usata per attendere che il socket sia scrivibile
+ */
+void outqueue_close(outqueue_t *q, long fd, int epfd);
+
+/**
+ * \brief Restituisce la generazione corrente della coda
+ *
+ * \param q La coda
+ * \return unsigned int La generazione, compresa fra 0 e \ref OUTQUEUE_MAX_GEN
+ */
+unsigned int outqueue_generation(outqueue_t *q);
+
+/**
+ * \brief Invia dei messaggi, accodando la parte che non può essere scritta
+ *        immediatamente
+ *
+ * \param q La coda della connessione
+ * \param fd Il descrittore della connessione
+ * \param gen La generazione della connessione a cui sono destinati i
+ *            messaggi, o \ref OUTQUEUE_ANY_GEN se \p fd non può essere stato
+ *            chiuso nel frattempo
+ * \param epfd L'istanza epoll usata per attendere che il socket sia scrivibile
+ * \param max Numero massimo di messaggi in coda (0: illimitato)
+ * \param policy Comportamento se la coda è piena
+ * \param msgs I messaggi da inviare. Gli header vengono sempre copiati se
+ *             necessario, mentre i dati vengono copiati solo se non sono
+ *             condivisi
+ * \param shared Per ogni messaggio, il messaggio condiviso che ne contiene
+ *               i dati, di cui viene acquisito un riferimento invece di
+ *               copiarli. Può essere NULL, come i suoi elementi
+ * \param n Il numero di messaggi
+ * \param header_only 1 se va inviato solamente l'header dei messaggi
+ * \return int >0 se i messaggi sono stati inviati o accodati,
+ *             =0 se il client si è disconnesso (o è stato disconnesso) o la
+ *             generazione non corrisponde,
+ *             <0 se si è verificato un errore. Se la coda è piena e la
+ *             politica è \ref OUTQUEUE_DROP, errno vale ENOBUFS
+ */
+int outqueue_send(outqueue_t *q, long fd, unsigned int gen, int epfd, size_t max, outqueue_policy_t policy,
+                  message_t **msgs, cmessage_t **shared, int n, int header_only);
+
+/**
+ * \brief Scrive sul socket quanto possibile dei messaggi in coda
+ *
+ * Va chiamata quando \p fd viene notificato come scrivibile su \p epfd.
+ * Se dopo la scrittura restano messaggi in coda, il descrittore viene
+ * riattivato su \p epfd.
+ *
+ * \param q La coda della connessione
+ * \param fd Il descrittore della connessione
+ * \param epfd L'istanza epoll usata per attendere che il socket sia scrivibile
+ */
+void outqueue_flush(outqueue_t *q, long fd, int epfd);
+
+#endif /* OUTQUEUE_H */
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Verifica che un client che invia una richiesta incompleta non blocchi gli
+# altri client serviti dallo stesso thread. Va eseguito con un server che
+# usa un solo event loop
+
+./client -l $1 -c pippo
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+# invio solo i primi 2 byte di una richiesta, senza chiudere la connessione
+perl -MIO::Socket::UNIX -e '
+    my $s = IO::Socket::UNIX->new(Type => SOCK_STREAM(), Peer => $ARGV[0]) or die;
+    syswrite($s, "\x01\x00");
+    sleep 10;' $1 &
+PARTIAL=$!
+sleep 1
+
+# un altro client deve essere servito normalmente
+timeout 5 ./client -l $1 -k pippo -L
+e=$?
+kill $PARTIAL
+wait $PARTIAL 2>/dev/null
+if [[ $e != 0 ]]; then
+    echo "Il client e' stato bloccato dalla richiesta incompleta"
+    exit 1
+fi
+
+# la richiesta incompleta non deve aver alterato lo stato del server
+./client -l $1 -k pippo -p
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+echo "Test OK!"
+exit 0
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Verifica che le richieste inviate di seguito da un client che non legge le
+# risposte vengano servite tutte, anche quando il suo socket non e' piu'
+# scrivibile. Va eseguito con un server che usa un solo thread
+
+./client -l $1 -c pippo
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+./client -l $1 -c pluto
+if [[ $? != 0 ]]; then
+    exit 1
+fi
+
+# pippo invia molte richieste USRLIST senza leggere le risposte, e per
+# ultimo un messaggio per pluto
+perl -MIO::Socket::UNIX -e '
+    sub req {
+        my ($op, $rcv, $buf) = @_;
+        return pack("l Z33 x3 Z33 x3 L", $op, "pippo", $rcv, length($buf)) . $buf;
+    }
+    my $s = IO::Socket::UNIX->new(Type => SOCK_STREAM(), Peer => $ARGV[0]) or die;
+    my $out = req(1, "", "") . (req(7, "", "") x 5000) . req(2, "pluto", "ciao\0");
+    while(length($out) > 0) {
+        my $n = syswrite($s, $out) or die;
+        substr($out, 0, $n) = "";
+    }
+    sleep 10;' $1 &
+PIPELINE=$!
+sleep 3
+
+./client -l $1 -k pluto -p | grep -q "\[pippo:\] ciao"
+e=$?
+kill $PIPELINE
+wait $PIPELINE 2>/dev/null
+if [[ $e != 0 ]]; then
+    echo "Le richieste del client che non legge non sono state servite"
+    exit 1
+fi
+
+echo "Test OK!"
+exit 0